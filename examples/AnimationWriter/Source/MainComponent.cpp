@@ -42,6 +42,8 @@ public:
                 videoWriter->setPixelAspect (1, 1);
                 videoWriter->setPixelFormat (AV_PIX_FMT_YUV420P);
                 videoWriter->setTimeBase (AVMEDIA_TYPE_VIDEO, av_make_q (1, 25));
+                // encode on a background thread, a second of frames can wait for the encoder
+                videoWriter->setAsyncEncoding (true, 25, FFmpegVideoWriter::blockWhenFull);
                 videoWriter->openMovieFile (chooser.getResult());
                 counter = 0;
             }
@@ -197,6 +197,7 @@ public:
         DBG ("====================================================");
 
         osdComponent->setVideoLength (videoReader->getVideoDuration ());
+        osdComponent->setVideoFile (video);
 
         transportSource->setSource (videoReader, 0, nullptr, videoReader->getVideoSamplingRate(), videoReader->getVideoChannels());
         readBuffer.setSize (videoReader->getVideoChannels(), readBuffer.getNumSamples());
@@ -42,7 +42,9 @@
 */
 class OSDComponent    : public Component,
                         public Slider::Listener,
-                        public Button::Listener
+                        public Button::Listener,
+                        public FFmpegPreviewDecoder::Listener,
+                        public FFmpegTranscoder::Listener
 {
 public:
     OSDComponent (FFmpegVideoReader* readerToControl, AudioTransportSource* transportToControl)
@@ -69,8 +71,15 @@ public:
         addAndMakeVisible (seekBar);
         seekBar->addListener (this);
         seekBar->setWantsKeyboardFocus (false);
+        seekBar->addMouseListener (this, false);
         flexBox.items.add (FlexItem (*seekBar).withFlex (6.0, 1.0, 0.5).withHeight (20.0));
 
+        stepBack = new TextButton ("<|", "Previous frame");
+        stepBack->addListener (this);
+        stepBack->setWantsKeyboardFocus (false);
+        addAndMakeVisible (stepBack);
+        flexBox.items.add (FlexItem (*stepBack).withFlex (0.5, 1.0, 0.5).withHeight (20.0));
+
         stop = new TextButton ("Stop", "Stop");
         stop->addListener (this);
         stop->setWantsKeyboardFocus (false);
@@ -83,12 +92,24 @@ public:
         addAndMakeVisible (pause);
         flexBox.items.add (FlexItem (*pause).withFlex (1.0, 1.0, 0.5).withHeight (20.0));
 
+        rewind = new TextButton ("Rev", "Play backwards");
+        rewind->addListener (this);
+        rewind->setWantsKeyboardFocus (false);
+        addAndMakeVisible (rewind);
+        flexBox.items.add (FlexItem (*rewind).withFlex (1.0, 1.0, 0.5).withHeight (20.0));
+
         play = new TextButton ("Play", "Play");
         play->addListener (this);
         play->setWantsKeyboardFocus (false);
         addAndMakeVisible (play);
         flexBox.items.add (FlexItem (*play).withFlex (1.0, 1.0, 0.5).withHeight (20.0));
 
+        stepNext = new TextButton ("|>", "Next frame");
+        stepNext->addListener (this);
+        stepNext->setWantsKeyboardFocus (false);
+        addAndMakeVisible (stepNext);
+        flexBox.items.add (FlexItem (*stepNext).withFlex (0.5, 1.0, 0.5).withHeight (20.0));
+
         ffwd = new TextButton ("FFWD", "FFWD");
         ffwd->addListener (this);
         ffwd->setWantsKeyboardFocus (false);
@@ -98,16 +119,35 @@ public:
         openFile->setConnectedEdges (TextButton::ConnectedOnRight);
         saveFile->setConnectedEdges (TextButton::ConnectedOnLeft);
 
-        stop->setConnectedEdges  (TextButton::ConnectedOnRight);
+        stepBack->setConnectedEdges (TextButton::ConnectedOnRight);
+        stop->setConnectedEdges  (TextButton::ConnectedOnRight | TextButton::ConnectedOnLeft);
         pause->setConnectedEdges (TextButton::ConnectedOnRight | TextButton::ConnectedOnLeft);
+        rewind->setConnectedEdges (TextButton::ConnectedOnRight | TextButton::ConnectedOnLeft);
         play->setConnectedEdges  (TextButton::ConnectedOnRight | TextButton::ConnectedOnLeft);
+        stepNext->setConnectedEdges (TextButton::ConnectedOnRight | TextButton::ConnectedOnLeft);
         ffwd->setConnectedEdges  (TextButton::ConnectedOnLeft);
 
+        preview = new ImageComponent ("Preview");
+        preview->setInterceptsMouseClicks (false, false);
+        addChildComponent (preview);
+        previewDecoder.addListener (this);
+        transcoder.addListener (this);
+
         idle = new MouseIdle (*this);
     }
 
     ~OSDComponent()
     {
+        transcoder.removeListener (this);
+        previewDecoder.removeListener (this);
+        seekBar->removeMouseListener (this);
+    }
+
+    /** The preview decoder opens the file separately, so it doesn't disturb the playback */
+    void setVideoFile (const File& file)
+    {
+        preview->setVisible (false);
+        previewDecoder.openMovieFile (file);
     }
 
     void paint (Graphics& g) override
@@ -146,6 +186,62 @@ public:
         }
     }
 
+    /** Show a preview of the position under the mouse without seeking the player */
+    void mouseMove (const MouseEvent& event) override
+    {
+        if (event.eventComponent == seekBar && seekBar->getWidth() > 0) {
+            const double proportion = jlimit (0.0, 1.0, event.position.x / static_cast<double> (seekBar->getWidth()));
+            previewPosition = event.getEventRelativeTo (this).position.x;
+            previewDecoder.requestPreview (seekBar->proportionOfLengthToValue (proportion));
+        }
+    }
+
+    void mouseExit (const MouseEvent& event) override
+    {
+        if (event.eventComponent == seekBar) {
+            previewDecoder.cancelPreview();
+            preview->setVisible (false);
+        }
+    }
+
+    void previewReady (const Image& image, const double seconds) override
+    {
+        Component::SafePointer<OSDComponent> safeThis (this);
+        MessageManager::callAsync ([safeThis, image] {
+            if (safeThis != nullptr)
+                safeThis->showPreview (image);
+        });
+    }
+
+    void showPreview (const Image& image)
+    {
+        if (! seekBar->isMouseOver() || ! image.isValid())
+            return;
+
+        preview->setImage (image);
+        Rectangle<int> area (image.getWidth(), image.getHeight());
+        area.setCentre (roundToInt (previewPosition), 0);
+        area.setY (seekBar->getY() - image.getHeight() - 4);
+        preview->setBounds (area.constrainedWithin (getLocalBounds()));
+        preview->setVisible (true);
+    }
+
+    /** While dragging only keyframes are shown, so scrubbing stays responsive */
+    void sliderDragStarted (juce::Slider* slider) override
+    {
+        if (slider == seekBar) {
+            videoReader->setScrubbing (true);
+        }
+    }
+
+    /** Refine to the exact frame, when the user lets go */
+    void sliderDragEnded (juce::Slider* slider) override
+    {
+        if (slider == seekBar) {
+            videoReader->setScrubbing (false);
+        }
+    }
+
     void buttonClicked (Button* b) override
     {
         if (b == openFile) {
@@ -158,6 +254,7 @@ public:
             }
         }
         else if (b == play) {
+            videoReader->setReversePlayback (false);
             if (ffwdSpeed != 2) {
                 int64 lastPos = videoReader->getNextReadPosition();
                 ffwdSpeed = 2;
@@ -169,11 +266,24 @@ public:
         }
         else if (b == stop) {
             transport->stop();
+            videoReader->setReversePlayback (false);
             videoReader->setNextReadPosition (0);
         }
         else if (b == pause) {
             transport->stop();
         }
+        else if (b == rewind) {
+            videoReader->setReversePlayback (true);
+            transport->start();
+        }
+        else if (b == stepBack) {
+            transport->stop();
+            videoReader->stepBackward();
+        }
+        else if (b == stepNext) {
+            transport->stop();
+            videoReader->stepForward();
+        }
         else if (b == ffwd) {
             int64 lastPos = videoReader->getNextReadPosition();
             ffwdSpeed = ++ffwdSpeed % 7;
@@ -184,45 +294,65 @@ public:
 
         }
         else if (b == saveFile) {
+            if (transcoder.isTranscoding()) {
+                transcoder.cancel();
+                return;
+            }
             transport->stop();
             FileChooser chooser ("Save Video File");
             if (chooser.browseForFileToSave (true)) {
                 File saveFileName = chooser.getResult();
 
-                FFmpegVideoReader copyReader;
-
-                FFmpegVideoWriter writer;
-                copyReader.addVideoListener (&writer);
-                copyReader.loadMovieFile (videoReader->getVideoFileName());
-                copyReader.prepareToPlay (1024, videoReader->getVideoSamplingRate());
+                copyReader = new FFmpegVideoReader();
+                copyWriter = new FFmpegVideoWriter();
+                copyReader->loadMovieFile (videoReader->getVideoFileName());
+                copyReader->prepareToPlay (1024, videoReader->getVideoSamplingRate());
 
-                AVRational videoTimeBase = copyReader.getVideoTimeBase();
+                AVRational videoTimeBase = copyReader->getVideoTimeBase();
                 if (videoTimeBase.num > 0) {
-                    writer.setTimeBase (AVMEDIA_TYPE_VIDEO, videoTimeBase);
+                    copyWriter->setTimeBase (AVMEDIA_TYPE_VIDEO, videoTimeBase);
                 }
-                writer.setVideoCodec (AV_CODEC_ID_PROBE);
-                writer.setAudioCodec (AV_CODEC_ID_PROBE);
-                writer.setVideoSize (copyReader.getVideoWidth(), copyReader.getVideoHeight());
-                writer.setPixelFormat (copyReader.getPixelFormat());
-                writer.openMovieFile (saveFileName);
-
-                AudioBuffer<float> buffer;
-                buffer.setSize (2, 1024);
-
-                while (copyReader.getCurrentTimeStamp() < copyReader.getVideoDuration()) {
-                    AudioSourceChannelInfo info (&buffer, 0, 1024);
-                    copyReader.waitForNextAudioBlockReady (info, 500);
-                    copyReader.getNextAudioBlock (info);
-
-                    writer.writeNextAudioBlock (info);
+                copyWriter->setVideoCodec (AV_CODEC_ID_PROBE);
+                copyWriter->setAudioCodec (AV_CODEC_ID_PROBE);
+                copyWriter->setVideoSize (copyReader->getVideoWidth(), copyReader->getVideoHeight());
+                copyWriter->setPixelFormat (copyReader->getPixelFormat());
+                // runs as fast as the codecs allow on the transcoder's thread and closes the writer
+                if (copyWriter->openMovieFile (saveFileName) && transcoder.transcode (*copyReader, *copyWriter, true)) {
+                    saveFile->setButtonText ("Cancel");
+                }
+                else {
+                    copyWriter = nullptr;
+                    copyReader = nullptr;
                 }
-                writer.closeMovieFile ();
-
-                copyReader.removeVideoListener (&writer);
             }
         }
     }
 
+    void transcodingProgress (FFmpegTranscoder&, const double progress) override
+    {
+        Component::SafePointer<OSDComponent> safeThis (this);
+        MessageManager::callAsync ([safeThis, progress] {
+            if (safeThis != nullptr && safeThis->transcoder.isTranscoding())
+                safeThis->saveFile->setButtonText ("Cancel " + String (roundToInt (progress * 100.0)) + "%");
+        });
+    }
+
+    void transcodingFinished (FFmpegTranscoder& t, const bool success) override
+    {
+        DBG ((success ? "Saved " : "Saving failed after ") + String (t.getElapsedTime(), 1) + " s, " +
+             String (t.getSpeed(), 1) + "x realtime");
+
+        // the job is done with the reader and writer, but this is still the transcoder's thread
+        Component::SafePointer<OSDComponent> safeThis (this);
+        MessageManager::callAsync ([safeThis] {
+            if (safeThis != nullptr && ! safeThis->transcoder.isTranscoding()) {
+                safeThis->copyWriter = nullptr;
+                safeThis->copyReader = nullptr;
+                safeThis->saveFile->setButtonText ("Save");
+            }
+        });
+    }
+
     class MouseIdle : public MouseListener, public Timer
     {
     public:
@@ -275,15 +405,26 @@ private:
 
     ScopedPointer<MouseIdle>            idle;
     ScopedPointer<Slider>               seekBar;
+    ScopedPointer<ImageComponent>       preview;
+    FFmpegPreviewDecoder                previewDecoder;
+    float                               previewPosition = 0.0f;
     ScopedPointer<TextButton>           openFile;
     ScopedPointer<TextButton>           saveFile;
     ScopedPointer<TextButton>           play;
     ScopedPointer<TextButton>           pause;
     ScopedPointer<TextButton>           stop;
     ScopedPointer<TextButton>           ffwd;
+    ScopedPointer<TextButton>           rewind;
+    ScopedPointer<TextButton>           stepBack;
+    ScopedPointer<TextButton>           stepNext;
     int                                 ffwdSpeed;
     FFmpegVideoReader*                  videoReader;
 
+    /** the copy being saved, the transcoder is declared last, so it stops before they are deleted */
+    ScopedPointer<FFmpegVideoReader>    copyReader;
+    ScopedPointer<FFmpegVideoWriter>    copyWriter;
+    FFmpegTranscoder                    transcoder;
+
     AudioTransportSource*               transport;
 };
 
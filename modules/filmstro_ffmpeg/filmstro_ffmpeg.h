@@ -68,6 +68,7 @@ extern "C" {
 #endif
 
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/samplefmt.h>
 #include <libavutil/timestamp.h>
 #include <libavutil/opt.h>
@@ -81,8 +82,19 @@ extern "C" {
 
 #include "filmstro_ffmpeg_FFmpegVideoListener.h"
 #include "filmstro_ffmpeg_FFmpegVideoScaler.h"
+#include "filmstro_ffmpeg_FFmpegPacketQueue.h"
+#include "filmstro_ffmpeg_FFmpegFrameQueue.h"
+#include "filmstro_ffmpeg_FFmpegFramePool.h"
+#include "filmstro_ffmpeg_FFmpegFrameCache.h"
+#include "filmstro_ffmpeg_FFmpegSeekIndex.h"
+#include "filmstro_ffmpeg_FFmpegInputStreamIO.h"
+#include "filmstro_ffmpeg_FFmpegOutputStreamIO.h"
+#include "filmstro_ffmpeg_FFmpegIndexCache.h"
+#include "filmstro_ffmpeg_FFmpegThumbnailGenerator.h"
+#include "filmstro_ffmpeg_FFmpegPreviewDecoder.h"
 #include "filmstro_ffmpeg_FFmpegVideoReader.h"
 #include "filmstro_ffmpeg_FFmpegVideoWriter.h"
+#include "filmstro_ffmpeg_FFmpegTranscoder.h"
 #include "filmstro_ffmpeg_FFmpegVideoComponent.h"
 
 
@@ -0,0 +1,253 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegFrameCache
+ \file         filmstro_ffmpeg_FFmpegFrameCache.h
+ \brief        Keeps recently decoded frames for random access
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  A least recently used cache of decoded video frames, keyed by
+               their presentation timestamp and limited by the size of the
+               picture buffers. The frames are referenced, not copied.
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGFRAMECACHE_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGFRAMECACHE_H_INCLUDED
+
+#include <list>
+#include <map>
+
+/**
+ The decoder adds every frame it decodes. When seeking to a position that was
+ visited recently, the frame can be displayed without decoding the GOP again.
+ All methods are thread safe.
+ */
+class FFmpegFrameCache {
+public:
+    FFmpegFrameCache (const juce::int64 maxBytes = 256 * 1024 * 1024)
+      : maximumSize (maxBytes),
+        currentSize (0),
+        reversePlayHead (-1.0)
+    {}
+
+    ~FFmpegFrameCache ()
+    {
+        clear();
+    }
+
+    /** Set the budget in bytes for the picture buffers. 0 disables the cache */
+    void setMaximumSize (const juce::int64 maxBytes)
+    {
+        const juce::ScopedLock lock (cacheLock);
+        maximumSize = juce::jmax (juce::int64 (0), maxBytes);
+        evict (0);
+    }
+
+    juce::int64 getMaximumSize () const
+    {
+        return maximumSize;
+    }
+
+    /** Returns the bytes referenced by the cached frames */
+    juce::int64 getCurrentSize () const
+    {
+        const juce::ScopedLock lock (cacheLock);
+        return currentSize;
+    }
+
+    int getNumFrames () const
+    {
+        const juce::ScopedLock lock (cacheLock);
+        return static_cast<int> (frames.size());
+    }
+
+    /** Adds a reference to the frame, which is displayed from pts for duration seconds */
+    void insert (const AVFrame* frame, const double pts, const double duration)
+    {
+        if (frame == nullptr || frame->buf [0] == nullptr)
+            return;
+
+        const juce::int64 bytes = getFrameSize (frame);
+
+        const juce::ScopedLock lock (cacheLock);
+        if (bytes > maximumSize)
+            return;
+
+        auto existing = frames.find (pts);
+        if (existing != frames.end()) {
+            touch (existing->second);
+            return;
+        }
+
+        evict (bytes);
+
+        AVFrame* cached = framePool->acquireFrame();
+        if (av_frame_ref (cached, frame) < 0) {
+            framePool->releaseFrame (cached);
+            return;
+        }
+
+        usage.push_front (pts);
+        Entry& entry   = frames [pts];
+        entry.frame    = cached;
+        entry.duration = duration;
+        entry.bytes    = bytes;
+        entry.usage    = usage.begin();
+        currentSize   += bytes;
+    }
+
+    /** In reverse playback the frames after the play head were shown already. Only those
+     are evicted, the farthest first. The chunks decoded ahead are kept until they are
+     displayed, even if they exceed the budget, e.g. long GOPs in 4K. A negative value
+     switches back to evicting the least recently used frames */
+    void setReversePlayHead (const double pts)
+    {
+        const juce::ScopedLock lock (cacheLock);
+        reversePlayHead = pts;
+        // the frames passed now, or all of them going forward, count against the budget again
+        evict (0);
+    }
+
+    /** Looks for the frame, that is due at pts and references it into dest.
+     Playback passes touchEntry = false, so displaying a frame doesn't keep it alive.
+     Returns false, if there is no such frame in the cache */
+    bool getFrame (const double pts, AVFrame* dest, double* framePTS = nullptr, const bool touchEntry = true)
+    {
+        const juce::ScopedLock lock (cacheLock);
+        auto it = frames.upper_bound (pts);
+        if (it == frames.begin())
+            return false;
+
+        --it;
+        if (pts >= it->first + it->second.duration)
+            return false;
+
+        av_frame_unref (dest);
+        if (av_frame_ref (dest, it->second.frame) < 0)
+            return false;
+
+        if (framePTS)
+            *framePTS = it->first;
+
+        if (touchEntry)
+            touch (it->second);
+        return true;
+    }
+
+    /** Returns true, if the frame due at pts is in the cache */
+    bool contains (const double pts) const
+    {
+        const juce::ScopedLock lock (cacheLock);
+        auto it = frames.upper_bound (pts);
+        if (it == frames.begin())
+            return false;
+
+        --it;
+        return pts < it->first + it->second.duration;
+    }
+
+    /** Releases all frames, e.g. when a different file was opened */
+    void clear ()
+    {
+        const juce::ScopedLock lock (cacheLock);
+        for (auto& entry : frames)
+            framePool->releaseFrame (entry.second.frame);
+        frames.clear();
+        usage.clear();
+        currentSize = 0;
+    }
+
+private:
+    struct Entry
+    {
+        AVFrame*                    frame;
+        double                      duration;
+        juce::int64                 bytes;
+        std::list<double>::iterator usage;
+    };
+
+    static juce::int64 getFrameSize (const AVFrame* frame)
+    {
+        juce::int64 bytes = 0;
+        for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf [i] != nullptr; ++i)
+            bytes += frame->buf [i]->size;
+        return bytes;
+    }
+
+    /** moves the entry to the front of the usage list */
+    void touch (Entry& entry)
+    {
+        usage.splice (usage.begin(), usage, entry.usage);
+    }
+
+    /** drops frames until there is space for bytesNeeded. In reverse playback only the
+     frames shown already go, otherwise the least recently used ones */
+    void evict (const juce::int64 bytesNeeded)
+    {
+        while (! frames.empty() && currentSize + bytesNeeded > maximumSize) {
+            auto it = std::prev (frames.end());
+            if (reversePlayHead >= 0.0) {
+                // the frames before the play head are still to be shown
+                if (it->first <= reversePlayHead)
+                    break;
+            }
+            else {
+                it = frames.find (usage.back());
+            }
+
+            jassert (it != frames.end());
+            usage.erase (it->second.usage);
+            currentSize -= it->second.bytes;
+            framePool->releaseFrame (it->second.frame);
+            frames.erase (it);
+        }
+    }
+
+    juce::CriticalSection                   cacheLock;
+    juce::int64                             maximumSize;
+    juce::int64                             currentSize;
+
+    /** the play head while playing backwards, or a negative value */
+    double                                  reversePlayHead;
+
+    /** the frames sorted by presentation timestamp */
+    std::map<double, Entry>                 frames;
+
+    /** timestamps of the frames, the most recently used first */
+    std::list<double>                       usage;
+
+    juce::SharedResourcePointer<FFmpegFramePool> framePool;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegFrameCache)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGFRAMECACHE_H_INCLUDED */
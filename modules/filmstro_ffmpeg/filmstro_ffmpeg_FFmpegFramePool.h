@@ -0,0 +1,224 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegFramePool
+ \file         filmstro_ffmpeg_FFmpegFramePool.h
+ \brief        Recycles AVFrames and their buffers
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  A pool of AVFrame structs and AVBufferPools for picture and
+               sample buffers. Share it using a juce::SharedResourcePointer,
+               so decoder, components and writers recycle the same frames.
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGFRAMEPOOL_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGFRAMEPOOL_H_INCLUDED
+
+/**
+ Frames handed to a FFmpegVideoListener are reference counted. To keep a frame
+ after the callback returned without copying the picture, acquire an empty frame
+ from the pool and av_frame_ref the received one. The decoder will then allocate
+ a new buffer instead of overwriting the referenced one. Release the frame back
+ to the pool when you are done.
+
+ Decoders set up with useForDecoder take their pictures from the same buffers, so
+ once the frames are released, the next pictures are decoded into them again.
+ */
+class FFmpegFramePool {
+public:
+    FFmpegFramePool () {}
+
+    ~FFmpegFramePool ()
+    {
+        const juce::ScopedLock lock (poolLock);
+        for (auto& frame : freeFrames)
+            av_frame_free (&frame);
+        for (auto& pool : bufferPools)
+            av_buffer_pool_uninit (&pool.second);
+    }
+
+    /** Returns an empty frame. Release it using releaseFrame */
+    AVFrame* acquireFrame ()
+    {
+        {
+            const juce::ScopedLock lock (poolLock);
+            if (! freeFrames.empty()) {
+                AVFrame* frame = freeFrames.back();
+                freeFrames.pop_back();
+                return frame;
+            }
+        }
+        return av_frame_alloc();
+    }
+
+    /** Returns a frame with a picture buffer for the given dimensions. The buffer
+     is taken from an AVBufferPool, so it will be reused once all references are gone. */
+    AVFrame* acquireFrame (const int width, const int height, const AVPixelFormat format)
+    {
+        const int size = av_image_get_buffer_size (format, width, height, alignment);
+        if (size < 0)
+            return nullptr;
+
+        AVFrame* frame = acquireFrame();
+        frame->buf [0] = getBuffer (size);
+        if (frame->buf [0] == nullptr) {
+            releaseFrame (frame);
+            return nullptr;
+        }
+        av_image_fill_arrays (frame->data, frame->linesize, frame->buf [0]->data,
+                              format, width, height, alignment);
+        frame->width  = width;
+        frame->height = height;
+        frame->format = format;
+        return frame;
+    }
+
+    /** Returns a frame with a sample buffer for the given number of samples and channels */
+    AVFrame* acquireFrame (const int numSamples, const AVSampleFormat format, const uint64_t channelLayout)
+    {
+        const int channels = av_get_channel_layout_nb_channels (channelLayout);
+        const int size = av_samples_get_buffer_size (nullptr, channels, numSamples, format, alignment);
+        if (size < 0 || channels > AV_NUM_DATA_POINTERS)
+            return nullptr;
+
+        AVFrame* frame = acquireFrame();
+        frame->buf [0] = getBuffer (size);
+        if (frame->buf [0] == nullptr) {
+            releaseFrame (frame);
+            return nullptr;
+        }
+        av_samples_fill_arrays (frame->data, frame->linesize, frame->buf [0]->data,
+                                channels, numSamples, format, alignment);
+        frame->nb_samples     = numSamples;
+        frame->format         = format;
+        frame->channel_layout = channelLayout;
+        frame->channels       = channels;
+        return frame;
+    }
+
+    /** Lets a decoder take its picture buffers from this pool instead of allocating
+     new ones for every frame. Call it before avcodec_open2. Codecs that can't decode
+     into buffers of the caller and hardware pictures keep the default allocator.
+     The pool has to outlive the context. */
+    void useForDecoder (AVCodecContext* context, const AVCodec* codec)
+    {
+        if (codec == nullptr || codec->type != AVMEDIA_TYPE_VIDEO || ! (codec->capabilities & AV_CODEC_CAP_DR1))
+            return;
+
+        context->opaque      = this;
+        context->get_buffer2 = getDecoderBuffer;
+#if LIBAVCODEC_VERSION_MAJOR < 59
+        // the pool is locked, so frame threads may call it at the same time
+        context->thread_safe_callbacks = 1;
+#endif
+    }
+
+    /** Drops the references of the frame and keeps it for reuse */
+    void releaseFrame (AVFrame* frame)
+    {
+        if (frame == nullptr)
+            return;
+
+        av_frame_unref (frame);
+        const juce::ScopedLock lock (poolLock);
+        freeFrames.push_back (frame);
+    }
+
+private:
+    static int getDecoderBuffer (AVCodecContext* context, AVFrame* frame, int flags)
+    {
+        const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get (static_cast<AVPixelFormat> (frame->format));
+        if (descriptor == nullptr || (descriptor->flags & AV_PIX_FMT_FLAG_HWACCEL) || context->opaque == nullptr)
+            return avcodec_default_get_buffer2 (context, frame, flags);
+
+        return static_cast<FFmpegFramePool*> (context->opaque)->fillDecoderFrame (context, frame);
+    }
+
+    /** Sets up the planes like avcodec_default_get_buffer2 does, but in one buffer from the pool */
+    int fillDecoderFrame (AVCodecContext* context, AVFrame* frame)
+    {
+        const AVPixelFormat format = static_cast<AVPixelFormat> (frame->format);
+
+        // the codec may write beyond the visible picture
+        int width  = frame->width;
+        int height = frame->height;
+        int linesizeAlign [AV_NUM_DATA_POINTERS];
+        avcodec_align_dimensions2 (context, &width, &height, linesizeAlign);
+
+        const int size = av_image_get_buffer_size (format, width, height, decoderAlignment);
+        if (size < 0)
+            return size;
+
+        // some decoders read a few bytes past the end of the last plane
+        frame->buf [0] = getBuffer (size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (frame->buf [0] == nullptr)
+            return AVERROR (ENOMEM);
+
+        const int ret = av_image_fill_arrays (frame->data, frame->linesize, frame->buf [0]->data,
+                                              format, width, height, decoderAlignment);
+        if (ret < 0) {
+            av_buffer_unref (&frame->buf [0]);
+            return ret;
+        }
+        frame->extended_data = frame->data;
+        return 0;
+    }
+
+    AVBufferRef* getBuffer (const int size)
+    {
+        const juce::ScopedLock lock (poolLock);
+        for (auto& pool : bufferPools)
+            if (pool.first == size)
+                return av_buffer_pool_get (pool.second);
+
+        if (bufferPools.size() >= maxBufferPools) {
+            // the buffers in use stay valid, the pool is freed with the last one
+            av_buffer_pool_uninit (&bufferPools.front().second);
+            bufferPools.erase (bufferPools.begin());
+        }
+        bufferPools.push_back (std::make_pair (size, av_buffer_pool_init (size, nullptr)));
+        return av_buffer_pool_get (bufferPools.back().second);
+    }
+
+    static const int alignment = 32;
+    /** covers the line size alignment all decoders ask for */
+    static const int decoderAlignment = 64;
+    static const size_t maxBufferPools = 8;
+
+    juce::CriticalSection                       poolLock;
+    std::vector<AVFrame*>                       freeFrames;
+    std::vector<std::pair<int, AVBufferPool*> > bufferPools;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegFramePool)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGFRAMEPOOL_H_INCLUDED */
@@ -0,0 +1,198 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegFrameQueue
+ \file         filmstro_ffmpeg_FFmpegFrameQueue.h
+ \brief        A lock free FIFO of decoded video frames
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  Single producer / single consumer ring of reference counted
+               AVFrames. The video decoder writes frames in presentation order,
+               the audio thread looks up the frame to present by its PTS.
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGFRAMEQUEUE_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGFRAMEQUEUE_H_INCLUDED
+
+#include <atomic>
+
+class FFmpegFrameQueue {
+public:
+    /** Creates a queue holding up to size-1 frames */
+    FFmpegFrameQueue (const int size)
+      : readIndex  (0),
+        writeIndex (0)
+    {
+        jassert (size > 1);
+        frames.resize (static_cast<size_t> (juce::jmax (2, size)));
+        timestamps.resize (frames.size(), 0.0);
+        serials.resize (frames.size(), 0);
+        for (auto& frame : frames)
+            frame = av_frame_alloc();
+    }
+
+    ~FFmpegFrameQueue ()
+    {
+        for (auto& frame : frames)
+            av_frame_free (&frame);
+    }
+
+    // ==============================================================================
+    // producer side
+    // ==============================================================================
+
+    /** Returns the frame to decode the next picture into, or nullptr if the queue
+     is full. The frame may still reference an old picture, avcodec_receive_frame
+     will unref it. */
+    AVFrame* getWriteFrame ()
+    {
+        const int write = writeIndex.load (std::memory_order_relaxed);
+        if (nextIndex (write) == readIndex.load (std::memory_order_acquire))
+            return nullptr;
+        return frames [write];
+    }
+
+    /** Publishes the frame returned by getWriteFrame to the consumer. The serial
+     tells the consumer, which seek the frame belongs to. */
+    void finishedWrite (const double pts, const int serial = 0)
+    {
+        const int write = writeIndex.load (std::memory_order_relaxed);
+        timestamps [write] = pts;
+        serials [write]    = serial;
+        writeIndex.store (nextIndex (write), std::memory_order_release);
+    }
+
+    /** Returns the number of frames, that can be written before the queue is full */
+    int getFreeSpace () const
+    {
+        return getSize() - 1 - getNumReady();
+    }
+
+    // ==============================================================================
+    // consumer side
+    // ==============================================================================
+
+    /** Returns the number of frames ready to be presented */
+    int getNumReady () const
+    {
+        const int write = writeIndex.load (std::memory_order_acquire);
+        const int read  = readIndex.load (std::memory_order_relaxed);
+        return (getSize() + write - read) % getSize();
+    }
+
+    /** Returns the PTS in seconds of the ready frame at index, counted from the oldest */
+    double getPTS (const int index) const
+    {
+        jassert (juce::isPositiveAndBelow (index, getNumReady()));
+        return timestamps [(readIndex.load (std::memory_order_relaxed) + index) % getSize()];
+    }
+
+    /** Returns the serial of the ready frame at index, counted from the oldest */
+    int getSerial (const int index) const
+    {
+        jassert (juce::isPositiveAndBelow (index, getNumReady()));
+        return serials [(readIndex.load (std::memory_order_relaxed) + index) % getSize()];
+    }
+
+    /** Releases frames from the front, that belong to another serial, e.g. decoded
+     before the last seek. Returns the number of dropped frames. */
+    int discardOtherSerials (const int serial)
+    {
+        const int numReady = getNumReady();
+        int numStale = 0;
+        while (numStale < numReady && getSerial (numStale) != serial)
+            ++numStale;
+
+        if (numStale > 0) {
+            const int read = readIndex.load (std::memory_order_relaxed);
+            readIndex.store ((read + numStale) % getSize(), std::memory_order_release);
+        }
+        return numStale;
+    }
+
+    /** Returns the index of the last ready frame with a PTS not later than pts,
+     or -1 if all ready frames are later. The frames are in presentation order,
+     so a binary search does the job. */
+    int findFrameForPTS (const double pts) const
+    {
+        int lower = 0;
+        int upper = getNumReady();
+        while (lower < upper) {
+            const int middle = (lower + upper) / 2;
+            if (getPTS (middle) <= pts)
+                lower = middle + 1;
+            else
+                upper = middle;
+        }
+        return lower - 1;
+    }
+
+    /** Moves the ready frame at index into destination and releases it together
+     with all older frames back to the producer */
+    void popFrame (const int index, AVFrame* destination)
+    {
+        jassert (juce::isPositiveAndBelow (index, getNumReady()));
+        const int slot = (readIndex.load (std::memory_order_relaxed) + index) % getSize();
+        av_frame_unref (destination);
+        av_frame_move_ref (destination, frames [slot]);
+        readIndex.store (nextIndex (slot), std::memory_order_release);
+    }
+
+    /** Releases all ready frames back to the producer */
+    void discardAll ()
+    {
+        readIndex.store (writeIndex.load (std::memory_order_acquire), std::memory_order_release);
+    }
+
+    /** Returns the number of slots in the ring */
+    int getSize () const
+    {
+        return static_cast<int> (frames.size());
+    }
+
+private:
+    int nextIndex (const int index) const
+    {
+        return (index + 1) % getSize();
+    }
+
+    std::vector<AVFrame*>   frames;
+    std::vector<double>     timestamps;
+    std::vector<int>        serials;
+
+    std::atomic<int>        readIndex;
+    std::atomic<int>        writeIndex;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegFrameQueue)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGFRAMEQUEUE_H_INCLUDED */
@@ -0,0 +1,366 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegIndexCache
+ \file         filmstro_ffmpeg_FFmpegIndexCache.cpp
+ \brief        Keeps stream information and keyframe index of a file on disk
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  A compact binary sidecar file for each media file, so reopening
+               a known file doesn't need to probe the streams and scan the
+               keyframes again.
+
+ ==============================================================================
+ */
+
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+namespace
+{
+    const int indexMagic   = static_cast<int> (ByteOrder::littleEndianInt ("FSIX"));
+    const int indexVersion = 1;
+
+    /** number of bytes hashed at the start and the end of the file */
+    const int hashBlockSize = 65536;
+
+    /** bytes of a stream in the index file without its extradata, and of a keyframe */
+    const int streamRecordSize   = 140;
+    const int keyframeRecordSize = 32;
+
+    /** limits to reject corrupt index files before allocating anything */
+    const int maxNumStreams      = 1024;
+    const int maxExtradataSize   = 16 * 1024 * 1024;
+
+    void writeRational (OutputStream& out, const AVRational& value)
+    {
+        out.writeInt (value.num);
+        out.writeInt (value.den);
+    }
+
+    AVRational readRational (InputStream& in)
+    {
+        const int num = in.readInt();
+        const int den = in.readInt();
+        return av_make_q (num, den);
+    }
+
+    /** FNV-1a, good enough to detect a changed file */
+    void addToHash (juce::uint64& hash, const void* data, const size_t numBytes)
+    {
+        const juce::uint8* bytes = static_cast<const juce::uint8*> (data);
+        for (size_t i=0; i < numBytes; ++i) {
+            hash ^= bytes [i];
+            hash *= 1099511628211ULL;
+        }
+    }
+}
+
+// ==============================================================================
+// Record
+// ==============================================================================
+
+FFmpegIndexCache::Record::Record ()
+  : duration      (0),
+    indexedStream (-1)
+{
+}
+
+FFmpegIndexCache::Record::~Record ()
+{
+    clear ();
+}
+
+void FFmpegIndexCache::Record::clear ()
+{
+    for (auto& stream : streams)
+        avcodec_parameters_free (&stream.parameters);
+    streams.clear();
+    keyframes.clear();
+    duration      = 0;
+    indexedStream = -1;
+}
+
+void FFmpegIndexCache::Record::copyStreamInfo (const AVFormatContext* context)
+{
+    clear ();
+    if (context == nullptr)
+        return;
+
+    duration = context->duration;
+    for (unsigned int i=0; i < context->nb_streams; ++i) {
+        const AVStream* stream = context->streams [i];
+        StreamInfo info;
+        info.parameters = avcodec_parameters_alloc();
+        avcodec_parameters_copy (info.parameters, stream->codecpar);
+        info.averageFrameRate = stream->avg_frame_rate;
+        info.realFrameRate    = stream->r_frame_rate;
+        streams.push_back (info);
+    }
+}
+
+void FFmpegIndexCache::Record::copyStreamInfo (const Record& other)
+{
+    clear ();
+    duration = other.duration;
+    for (const auto& otherInfo : other.streams) {
+        StreamInfo info = otherInfo;
+        info.parameters = avcodec_parameters_alloc();
+        avcodec_parameters_copy (info.parameters, otherInfo.parameters);
+        streams.push_back (info);
+    }
+}
+
+bool FFmpegIndexCache::Record::applyStreamInfo (AVFormatContext* context) const
+{
+    if (context == nullptr || context->nb_streams != streams.size())
+        return false;
+
+    for (unsigned int i=0; i < context->nb_streams; ++i) {
+        if (context->streams [i]->codecpar->codec_type != streams [i].parameters->codec_type)
+            return false;
+    }
+
+    for (unsigned int i=0; i < context->nb_streams; ++i) {
+        AVStream* stream = context->streams [i];
+        avcodec_parameters_copy (stream->codecpar, streams [i].parameters);
+        stream->avg_frame_rate = streams [i].averageFrameRate;
+        stream->r_frame_rate   = streams [i].realFrameRate;
+    }
+    context->duration = duration;
+    return true;
+}
+
+// ==============================================================================
+// FFmpegIndexCache
+// ==============================================================================
+
+FFmpegIndexCache::FFmpegIndexCache (const juce::File& directory)
+  : cacheDirectory (directory)
+{
+}
+
+juce::File FFmpegIndexCache::getIndexFile (const juce::File& mediaFile) const
+{
+    // the key doesn't depend on the path, so a moved file is still found
+    const String key = String::toHexString (calculatePartialHash (mediaFile)) + "_" +
+                       String::toHexString (mediaFile.getSize());
+    return cacheDirectory.getChildFile (key).withFileExtension ("fsidx");
+}
+
+juce::int64 FFmpegIndexCache::calculatePartialHash (const juce::File& file)
+{
+    juce::uint64 hash = 14695981039346656037ULL;
+    const juce::int64 size = file.getSize();
+    addToHash (hash, &size, sizeof (size));
+
+    FileInputStream input (file);
+    if (input.openedOk()) {
+        HeapBlock<char> block (hashBlockSize);
+        int numRead = input.read (block.getData(), hashBlockSize);
+        addToHash (hash, block.getData(), static_cast<size_t> (jmax (0, numRead)));
+
+        if (size > 2 * hashBlockSize && input.setPosition (size - hashBlockSize)) {
+            numRead = input.read (block.getData(), hashBlockSize);
+            addToHash (hash, block.getData(), static_cast<size_t> (jmax (0, numRead)));
+        }
+    }
+    return static_cast<juce::int64> (hash);
+}
+
+bool FFmpegIndexCache::readRecord (const juce::File& mediaFile, Record& record) const
+{
+    record.clear();
+
+    const File indexFile = getIndexFile (mediaFile);
+    if (! indexFile.existsAsFile())
+        return false;
+
+    MemoryMappedFile mapped (indexFile, MemoryMappedFile::readOnly);
+    if (mapped.getData() == nullptr)
+        return false;
+
+    MemoryInputStream in (mapped.getData(), mapped.getSize(), false);
+
+    if (in.readInt() != indexMagic || in.readInt() != indexVersion)
+        return false;
+
+    if (in.readInt64() != mediaFile.getSize() ||
+        in.readInt64() != mediaFile.getLastModificationTime().toMilliseconds() ||
+        in.readInt64() != calculatePartialHash (mediaFile)) {
+        DBG ("Index cache: " + mediaFile.getFileName() + " has changed");
+        return false;
+    }
+
+    record.duration = in.readInt64();
+
+    const int numStreams = in.readInt();
+    if (numStreams < 0 || numStreams > maxNumStreams ||
+        in.getNumBytesRemaining() < static_cast<juce::int64> (numStreams) * streamRecordSize) {
+        DBG ("Index cache: corrupt stream count in " + indexFile.getFileName());
+        return false;
+    }
+
+    for (int i=0; i < numStreams && ! in.isExhausted(); ++i) {
+        StreamInfo info;
+        info.parameters = avcodec_parameters_alloc();
+        AVCodecParameters* par = info.parameters;
+        par->codec_type             = static_cast<AVMediaType> (in.readInt());
+        par->codec_id               = static_cast<AVCodecID> (in.readInt());
+        par->codec_tag              = static_cast<uint32_t> (in.readInt());
+        par->format                 = in.readInt();
+        par->bit_rate               = in.readInt64();
+        par->bits_per_coded_sample  = in.readInt();
+        par->bits_per_raw_sample    = in.readInt();
+        par->profile                = in.readInt();
+        par->level                  = in.readInt();
+        par->width                  = in.readInt();
+        par->height                 = in.readInt();
+        par->sample_aspect_ratio    = readRational (in);
+        par->field_order            = static_cast<AVFieldOrder> (in.readInt());
+        par->color_range            = static_cast<AVColorRange> (in.readInt());
+        par->color_primaries        = static_cast<AVColorPrimaries> (in.readInt());
+        par->color_trc              = static_cast<AVColorTransferCharacteristic> (in.readInt());
+        par->color_space            = static_cast<AVColorSpace> (in.readInt());
+        par->chroma_location        = static_cast<AVChromaLocation> (in.readInt());
+        par->video_delay            = in.readInt();
+        par->channel_layout         = static_cast<uint64_t> (in.readInt64());
+        par->channels               = in.readInt();
+        par->sample_rate            = in.readInt();
+        par->block_align            = in.readInt();
+        par->frame_size             = in.readInt();
+        par->initial_padding        = in.readInt();
+        par->trailing_padding       = in.readInt();
+        par->seek_preroll           = in.readInt();
+        info.averageFrameRate       = readRational (in);
+        info.realFrameRate          = readRational (in);
+
+        const int extradataSize = in.readInt();
+        if (extradataSize < 0 || extradataSize > maxExtradataSize || extradataSize > in.getNumBytesRemaining()) {
+            DBG ("Index cache: corrupt extradata in " + indexFile.getFileName());
+            avcodec_parameters_free (&info.parameters);
+            record.clear();
+            return false;
+        }
+        if (extradataSize > 0) {
+            par->extradata = static_cast<uint8_t*> (av_mallocz (static_cast<size_t> (extradataSize) + AV_INPUT_BUFFER_PADDING_SIZE));
+            par->extradata_size = in.read (par->extradata, extradataSize);
+        }
+        record.streams.push_back (info);
+    }
+
+    record.indexedStream = in.readInt();
+    const int numKeyframes = in.readInt();
+    if (numKeyframes < 0 || in.getNumBytesRemaining() < static_cast<juce::int64> (numKeyframes) * keyframeRecordSize) {
+        DBG ("Index cache: corrupt keyframe count in " + indexFile.getFileName());
+        record.clear();
+        return false;
+    }
+
+    record.keyframes.resize (static_cast<size_t> (numKeyframes));
+    for (auto& keyframe : record.keyframes) {
+        keyframe.pos     = in.readInt64();
+        keyframe.pts     = in.readInt64();
+        keyframe.dts     = in.readInt64();
+        keyframe.seconds = in.readDouble();
+    }
+
+    return static_cast<int> (record.streams.size()) == numStreams;
+}
+
+bool FFmpegIndexCache::writeRecord (const juce::File& mediaFile, const Record& record) const
+{
+    if (! cacheDirectory.createDirectory())
+        return false;
+
+    const File indexFile = getIndexFile (mediaFile);
+    TemporaryFile temp (indexFile);
+    {
+        FileOutputStream out (temp.getFile());
+        if (! out.openedOk())
+            return false;
+
+        out.writeInt (indexMagic);
+        out.writeInt (indexVersion);
+        out.writeInt64 (mediaFile.getSize());
+        out.writeInt64 (mediaFile.getLastModificationTime().toMilliseconds());
+        out.writeInt64 (calculatePartialHash (mediaFile));
+        out.writeInt64 (record.duration);
+
+        out.writeInt (static_cast<int> (record.streams.size()));
+        for (const auto& info : record.streams) {
+            const AVCodecParameters* par = info.parameters;
+            out.writeInt (par->codec_type);
+            out.writeInt (par->codec_id);
+            out.writeInt (static_cast<int> (par->codec_tag));
+            out.writeInt (par->format);
+            out.writeInt64 (par->bit_rate);
+            out.writeInt (par->bits_per_coded_sample);
+            out.writeInt (par->bits_per_raw_sample);
+            out.writeInt (par->profile);
+            out.writeInt (par->level);
+            out.writeInt (par->width);
+            out.writeInt (par->height);
+            writeRational (out, par->sample_aspect_ratio);
+            out.writeInt (par->field_order);
+            out.writeInt (par->color_range);
+            out.writeInt (par->color_primaries);
+            out.writeInt (par->color_trc);
+            out.writeInt (par->color_space);
+            out.writeInt (par->chroma_location);
+            out.writeInt (par->video_delay);
+            out.writeInt64 (static_cast<juce::int64> (par->channel_layout));
+            out.writeInt (par->channels);
+            out.writeInt (par->sample_rate);
+            out.writeInt (par->block_align);
+            out.writeInt (par->frame_size);
+            out.writeInt (par->initial_padding);
+            out.writeInt (par->trailing_padding);
+            out.writeInt (par->seek_preroll);
+            writeRational (out, info.averageFrameRate);
+            writeRational (out, info.realFrameRate);
+            out.writeInt (par->extradata_size);
+            if (par->extradata_size > 0)
+                out.write (par->extradata, static_cast<size_t> (par->extradata_size));
+        }
+
+        out.writeInt (record.indexedStream);
+        out.writeInt (static_cast<int> (record.keyframes.size()));
+        for (const auto& keyframe : record.keyframes) {
+            out.writeInt64 (keyframe.pos);
+            out.writeInt64 (keyframe.pts);
+            out.writeInt64 (keyframe.dts);
+            out.writeDouble (keyframe.seconds);
+        }
+        out.flush();
+        if (out.getStatus().failed())
+            return false;
+    }
+    return temp.overwriteTargetFileWithTemporary();
+}
@@ -0,0 +1,126 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegIndexCache
+ \file         filmstro_ffmpeg_FFmpegIndexCache.h
+ \brief        Keeps stream information and keyframe index of a file on disk
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  A compact binary sidecar file for each media file, so reopening
+               a known file doesn't need to probe the streams and scan the
+               keyframes again.
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGINDEXCACHE_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGINDEXCACHE_H_INCLUDED
+
+/**
+ \class         FFmpegIndexCache
+ \description   Reads and writes index files in a cache directory
+
+ A cached index is only used, if the size, the modification time and a hash of
+ the beginning and the end of the media file still match. The index files are
+ memory mapped for reading.
+ */
+class FFmpegIndexCache
+{
+public:
+    /** The codec parameters of one stream, as they are after avformat_find_stream_info */
+    struct StreamInfo
+    {
+        AVCodecParameters*  parameters;
+        AVRational          averageFrameRate;
+        AVRational          realFrameRate;
+    };
+
+    /**
+     \class         FFmpegIndexCache::Record
+     \description   The cached information about one media file
+     */
+    class Record
+    {
+    public:
+        Record ();
+        ~Record ();
+
+        /** Copies the stream information of an opened and probed format context */
+        void copyStreamInfo (const AVFormatContext* context);
+
+        /** Sets the cached stream information to a freshly opened format context,
+         so avformat_find_stream_info can be skipped. Returns false, if the
+         streams don't match. */
+        bool applyStreamInfo (AVFormatContext* context) const;
+
+        /** Copies the stream information of another record, but not the keyframes */
+        void copyStreamInfo (const Record& other);
+
+        /** Drops all information */
+        void clear ();
+
+        /** duration in AV_TIME_BASE units */
+        juce::int64                         duration;
+
+        std::vector<StreamInfo>             streams;
+
+        /** the stream the keyframes belong to */
+        int                                 indexedStream;
+
+        std::vector<FFmpegSeekIndex::Entry> keyframes;
+
+    private:
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Record)
+    };
+
+    /** Creates a cache, that keeps the index files in the given directory */
+    FFmpegIndexCache (const juce::File& directory);
+
+    /** Reads the cached record of a media file. Returns false, if there is none
+     or the media file was changed since it was written */
+    bool readRecord (const juce::File& mediaFile, Record& record) const;
+
+    /** Writes the record of a media file into the cache */
+    bool writeRecord (const juce::File& mediaFile, const Record& record) const;
+
+    /** Returns the file the index of the mediaFile is stored in */
+    juce::File getIndexFile (const juce::File& mediaFile) const;
+
+    /** Returns a hash over size, beginning and end of the file. This is much
+     faster than a full hash, but catches the usual changes of a media file */
+    static juce::int64 calculatePartialHash (const juce::File& file);
+
+private:
+    juce::File      cacheDirectory;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegIndexCache)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGINDEXCACHE_H_INCLUDED */
@@ -0,0 +1,192 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegInputStreamIO
+ \file         filmstro_ffmpeg_FFmpegInputStreamIO.cpp
+ \brief        Lets ffmpeg read from a juce::InputStream or a memory mapped file
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  A custom AVIOContext, that reads media from any juce::InputStream,
+               e.g. a MemoryInputStream of embedded data, or directly from a
+               memory mapped file.
+
+ ==============================================================================
+ */
+
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_MAC || JUCE_IOS || JUCE_LINUX || JUCE_ANDROID
+ #include <sys/mman.h>
+ #include <unistd.h>
+ #define FILMSTRO_FFMPEG_USE_MADVISE 1
+#endif
+
+namespace
+{
+    /** how far ahead of the read position the pages of a mapped file should be loaded */
+    const juce::int64 readAheadSize = 4 * 1024 * 1024;
+}
+
+FFmpegInputStreamIO::FFmpegInputStreamIO (InputStream* inputToUse, const bool takeOwnership, const int bufferSize)
+  : input       (inputToUse, takeOwnership),
+    mappedData  (nullptr),
+    mappedSize  (0),
+    position    (0),
+    advisedUpTo (0),
+    ioContext   (nullptr)
+{
+    // streams with an unknown length usually can't seek either
+    createContext (bufferSize, input != nullptr && input->getTotalLength() >= 0);
+}
+
+FFmpegInputStreamIO::FFmpegInputStreamIO (MemoryMappedFile* mappedFile, const int bufferSize)
+  : input       (nullptr, false),
+    mapped      (mappedFile),
+    mappedData  (static_cast<const uint8_t*> (mappedFile->getData())),
+    mappedSize  (static_cast<juce::int64> (mappedFile->getSize())),
+    position    (0),
+    advisedUpTo (0),
+    ioContext   (nullptr)
+{
+#ifdef FILMSTRO_FFMPEG_USE_MADVISE
+    madvise (const_cast<uint8_t*> (mappedData), static_cast<size_t> (mappedSize), MADV_SEQUENTIAL);
+#endif
+    adviseReadAhead ();
+    createContext (bufferSize, true);
+}
+
+FFmpegInputStreamIO::~FFmpegInputStreamIO ()
+{
+    if (ioContext) {
+        // the buffer might have been replaced by ffmpeg, so free the current one
+        av_freep (&ioContext->buffer);
+        av_freep (&ioContext);
+    }
+}
+
+FFmpegInputStreamIO* FFmpegInputStreamIO::createForMappedFile (const File& file, const int bufferSize)
+{
+    ScopedPointer<MemoryMappedFile> mappedFile = new MemoryMappedFile (file, MemoryMappedFile::readOnly);
+    if (mappedFile->getData() == nullptr || mappedFile->getSize() == 0) {
+        DBG ("Could not map " + file.getFullPathName() + " into memory");
+        return nullptr;
+    }
+    return new FFmpegInputStreamIO (mappedFile.release(), bufferSize);
+}
+
+AVIOContext* FFmpegInputStreamIO::getContext () const
+{
+    return ioContext;
+}
+
+void FFmpegInputStreamIO::createContext (const int bufferSize, const bool seekable)
+{
+    uint8_t* buffer = static_cast<uint8_t*> (av_malloc (static_cast<size_t> (bufferSize)));
+    if (buffer == nullptr)
+        return;
+
+    ioContext = avio_alloc_context (buffer, bufferSize, 0, this, &FFmpegInputStreamIO::readPacket, nullptr,
+                                    seekable ? &FFmpegInputStreamIO::seek : nullptr);
+    if (ioContext == nullptr) {
+        av_free (buffer);
+        return;
+    }
+    ioContext->seekable = seekable ? AVIO_SEEKABLE_NORMAL : 0;
+}
+
+int FFmpegInputStreamIO::readPacket (void* opaque, uint8_t* buffer, int size)
+{
+    return static_cast<FFmpegInputStreamIO*> (opaque)->read (buffer, size);
+}
+
+int FFmpegInputStreamIO::read (uint8_t* buffer, int size)
+{
+    if (mappedData != nullptr) {
+        const int numRead = static_cast<int> (jmin (static_cast<juce::int64> (size), mappedSize - position));
+        if (numRead <= 0)
+            return AVERROR_EOF;
+
+        memcpy (buffer, mappedData + position, static_cast<size_t> (numRead));
+        position += numRead;
+        adviseReadAhead ();
+        return numRead;
+    }
+
+    if (input == nullptr)
+        return AVERROR_EOF;
+
+    const int numRead = input->read (buffer, size);
+    return numRead > 0 ? numRead : AVERROR_EOF;
+}
+
+int64_t FFmpegInputStreamIO::seek (void* opaque, int64_t offset, int whence)
+{
+    FFmpegInputStreamIO* io = static_cast<FFmpegInputStreamIO*> (opaque);
+    const juce::int64 length = io->mappedData != nullptr ? io->mappedSize : io->input->getTotalLength();
+
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE)
+        return length >= 0 ? length : AVERROR (ENOSYS);
+
+    juce::int64 target = offset;
+    if (whence == SEEK_CUR)
+        target += io->mappedData != nullptr ? io->position : io->input->getPosition();
+    else if (whence == SEEK_END)
+        target += length;
+
+    if (target < 0 || (length >= 0 && target > length))
+        return AVERROR (EINVAL);
+
+    if (io->mappedData != nullptr) {
+        io->position    = target;
+        io->advisedUpTo = target;
+        io->adviseReadAhead ();
+        return target;
+    }
+
+    return io->input->setPosition (target) ? target : AVERROR (EIO);
+}
+
+void FFmpegInputStreamIO::adviseReadAhead ()
+{
+#ifdef FILMSTRO_FFMPEG_USE_MADVISE
+    // ask for the next window, when the reader used up half of the last one
+    if (position + readAheadSize / 2 < advisedUpTo)
+        return;
+
+    static const juce::int64 pageSize = sysconf (_SC_PAGESIZE);
+    const juce::int64 start = (position / pageSize) * pageSize;
+    const juce::int64 end   = jmin (mappedSize, position + readAheadSize);
+    if (end > start) {
+        madvise (const_cast<uint8_t*> (mappedData) + start, static_cast<size_t> (end - start), MADV_WILLNEED);
+    }
+    advisedUpTo = end;
+#endif
+}
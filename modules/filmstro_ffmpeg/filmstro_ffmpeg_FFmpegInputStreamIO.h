@@ -0,0 +1,98 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegInputStreamIO
+ \file         filmstro_ffmpeg_FFmpegInputStreamIO.h
+ \brief        Lets ffmpeg read from a juce::InputStream or a memory mapped file
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  A custom AVIOContext, that reads media from any juce::InputStream,
+               e.g. a MemoryInputStream of embedded data, or directly from a
+               memory mapped file.
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGINPUTSTREAMIO_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGINPUTSTREAMIO_H_INCLUDED
+
+/**
+ \class         FFmpegInputStreamIO
+ \description   Custom input for avformat_open_input
+
+ Set getContext() as pb of a format context allocated with avformat_alloc_context
+ and add AVFMT_FLAG_CUSTOM_IO to its flags. The FFmpegInputStreamIO has to outlive
+ the format context.
+ */
+class FFmpegInputStreamIO
+{
+public:
+    /** Creates an IO reading from input. If takeOwnership is true, the stream is
+     deleted with this object. The stream must not be used by anybody else. */
+    FFmpegInputStreamIO (juce::InputStream* input, const bool takeOwnership, const int bufferSize = 32768);
+
+    ~FFmpegInputStreamIO ();
+
+    /** Maps the file into memory and reads from there. On POSIX systems the kernel is
+     told to expect sequential reads and to read ahead of the position. Returns
+     nullptr, if the file couldn't be mapped. */
+    static FFmpegInputStreamIO* createForMappedFile (const juce::File& file, const int bufferSize = 32768);
+
+    /** Returns the context to set as AVFormatContext::pb */
+    AVIOContext* getContext () const;
+
+private:
+    FFmpegInputStreamIO (juce::MemoryMappedFile* mappedFile, const int bufferSize);
+
+    void createContext (const int bufferSize, const bool seekable);
+
+    static int readPacket (void* opaque, uint8_t* buffer, int size);
+
+    static int64_t seek (void* opaque, int64_t offset, int whence);
+
+    int read (uint8_t* buffer, int size);
+
+    /** hints the kernel to load the pages ahead of the read position */
+    void adviseReadAhead ();
+
+    juce::OptionalScopedPointer<juce::InputStream>  input;
+
+    juce::ScopedPointer<juce::MemoryMappedFile>     mapped;
+    const uint8_t*                                  mappedData;
+    juce::int64                                     mappedSize;
+    juce::int64                                     position;
+    juce::int64                                     advisedUpTo;
+
+    AVIOContext*                                    ioContext;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegInputStreamIO)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGINPUTSTREAMIO_H_INCLUDED */
@@ -0,0 +1,119 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+
+ \class        FFmpegOutputStreamIO
+ \file         filmstro_ffmpeg_FFmpegOutputStreamIO.cpp
+ \brief        Lets ffmpeg write to a juce::OutputStream
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  A custom AVIOContext, that writes the muxed output into any
+               juce::OutputStream, e.g. a MemoryOutputStream or a pipe.
+
+ ==============================================================================
+ */
+
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+FFmpegOutputStreamIO::FFmpegOutputStreamIO (OutputStream* outputToUse, const bool takeOwnership, const int bufferSize)
+  : output    (outputToUse, takeOwnership),
+    seekable  (false),
+    ioContext (nullptr)
+{
+    if (output == nullptr)
+        return;
+
+    // pipes and sockets refuse to move, files and memory blocks accept the current position
+    seekable = output->setPosition (output->getPosition());
+
+    uint8_t* buffer = static_cast<uint8_t*> (av_malloc (static_cast<size_t> (bufferSize)));
+    if (buffer == nullptr)
+        return;
+
+    ioContext = avio_alloc_context (buffer, bufferSize, 1, this, nullptr, &FFmpegOutputStreamIO::writePacket,
+                                    seekable ? &FFmpegOutputStreamIO::seek : nullptr);
+    if (ioContext == nullptr) {
+        av_free (buffer);
+        return;
+    }
+    ioContext->seekable = seekable ? AVIO_SEEKABLE_NORMAL : 0;
+}
+
+FFmpegOutputStreamIO::~FFmpegOutputStreamIO ()
+{
+    if (ioContext) {
+        avio_flush (ioContext);
+        // the buffer might have been replaced by ffmpeg, so free the current one
+        av_freep (&ioContext->buffer);
+        av_freep (&ioContext);
+    }
+    if (output != nullptr)
+        output->flush();
+}
+
+AVIOContext* FFmpegOutputStreamIO::getContext () const
+{
+    return ioContext;
+}
+
+bool FFmpegOutputStreamIO::isSeekable () const
+{
+    return seekable;
+}
+
+int FFmpegOutputStreamIO::writePacket (void* opaque, uint8_t* buffer, int size)
+{
+    FFmpegOutputStreamIO* io = static_cast<FFmpegOutputStreamIO*> (opaque);
+    if (io->output == nullptr || ! io->output->write (buffer, static_cast<size_t> (size)))
+        return AVERROR (EIO);
+
+    return size;
+}
+
+int64_t FFmpegOutputStreamIO::seek (void* opaque, int64_t offset, int whence)
+{
+    FFmpegOutputStreamIO* io = static_cast<FFmpegOutputStreamIO*> (opaque);
+
+    // the total length of an output stream is not known while writing
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE)
+        return AVERROR (ENOSYS);
+
+    juce::int64 target = offset;
+    if (whence == SEEK_CUR)
+        target += io->output->getPosition();
+    else if (whence == SEEK_END)
+        return AVERROR (ENOSYS);
+
+    if (target < 0)
+        return AVERROR (EINVAL);
+
+    return io->output->setPosition (target) ? target : AVERROR (EIO);
+}
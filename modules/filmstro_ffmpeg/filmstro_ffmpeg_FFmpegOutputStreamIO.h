@@ -0,0 +1,86 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+
+ \class        FFmpegOutputStreamIO
+ \file         filmstro_ffmpeg_FFmpegOutputStreamIO.h
+ \brief        Lets ffmpeg write to a juce::OutputStream
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  A custom AVIOContext, that writes the muxed output into any
+               juce::OutputStream, e.g. a MemoryOutputStream or a pipe.
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGOUTPUTSTREAMIO_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGOUTPUTSTREAMIO_H_INCLUDED
+
+/**
+ \class         FFmpegOutputStreamIO
+ \description   Custom output for avformat_write_header
+
+ Set getContext() as pb of an output format context and add AVFMT_FLAG_CUSTOM_IO
+ to its flags. The FFmpegOutputStreamIO has to outlive the format context.
+
+ If the stream can't seek, the muxer can't go back to patch the header. For mp4
+ or mov set the option movflags to "frag_keyframe+empty_moov" in that case.
+ */
+class FFmpegOutputStreamIO
+{
+public:
+    /** Creates an IO writing to output. If takeOwnership is true, the stream is
+     deleted with this object. The stream must not be used by anybody else. */
+    FFmpegOutputStreamIO (juce::OutputStream* output, const bool takeOwnership, const int bufferSize = 65536);
+
+    /** Flushes the remaining buffer into the stream */
+    ~FFmpegOutputStreamIO ();
+
+    /** Returns the context to set as AVFormatContext::pb */
+    AVIOContext* getContext () const;
+
+    /** Returns true, if the stream accepts setPosition */
+    bool isSeekable () const;
+
+private:
+    static int writePacket (void* opaque, uint8_t* buffer, int size);
+
+    static int64_t seek (void* opaque, int64_t offset, int whence);
+
+    juce::OptionalScopedPointer<juce::OutputStream> output;
+
+    bool                                            seekable;
+
+    AVIOContext*                                    ioContext;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegOutputStreamIO)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGOUTPUTSTREAMIO_H_INCLUDED */
@@ -0,0 +1,161 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegPacketQueue
+ \file         filmstro_ffmpeg_FFmpegPacketQueue.h
+ \brief        A thread safe queue of demuxed packets
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  The demuxer pushes the packets of one stream into this queue,
+               the decoder thread of that stream pops them
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGPACKETQUEUE_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGPACKETQUEUE_H_INCLUDED
+
+#include <deque>
+
+class FFmpegPacketQueue {
+public:
+    /** Creates an empty packet queue */
+    FFmpegPacketQueue () : totalSize (0) {}
+
+    ~FFmpegPacketQueue ()
+    {
+        clear ();
+    }
+
+    /** Adds a packet to the end of the queue. The queue takes a reference to
+     the packet data, so the caller still has to unref the packet. The serial
+     tells the decoder, which seek the packet belongs to. */
+    void push (AVPacket* packet, const int serial = 0)
+    {
+        AVPacket* queued = av_packet_alloc ();
+        if (av_packet_ref (queued, packet) < 0) {
+            DBG ("Could not reference packet for queue");
+            av_packet_free (&queued);
+            return;
+        }
+        {
+            const juce::ScopedLock lock (queueLock);
+            packets.push_back (std::make_pair (queued, serial));
+            totalSize += queued->size;
+        }
+        packetAdded.signal ();
+    }
+
+    /** Adds an empty packet. When it is popped, the decoder should drain the codec
+     like at the end of the stream, e.g. to finish a chunk of packets */
+    void pushDrainMarker (const int serial = 0)
+    {
+        AVPacket* marker = av_packet_alloc ();
+        {
+            const juce::ScopedLock lock (queueLock);
+            packets.push_back (std::make_pair (marker, serial));
+        }
+        packetAdded.signal ();
+    }
+
+    /** Returns true, if the popped packet was added by pushDrainMarker */
+    static bool isDrainMarker (const AVPacket& packet)
+    {
+        return packet.data == nullptr && packet.size == 0;
+    }
+
+    /** Moves the oldest packet into packet. Returns false, if the queue was empty.
+     The caller has to unref the packet after use. */
+    bool pop (AVPacket* packet, int& serial)
+    {
+        AVPacket* queued = nullptr;
+        {
+            const juce::ScopedLock lock (queueLock);
+            if (packets.empty())
+                return false;
+            queued = packets.front().first;
+            serial = packets.front().second;
+            packets.pop_front();
+            totalSize -= queued->size;
+        }
+        av_packet_move_ref (packet, queued);
+        av_packet_free (&queued);
+        return true;
+    }
+
+    /** Blocks until a packet was pushed or the timeout expired */
+    bool waitForPacket (const int timeOutMilliseconds)
+    {
+        return packetAdded.wait (timeOutMilliseconds);
+    }
+
+    /** Wakes up a thread waiting for a packet, e.g. to let it check threadShouldExit */
+    void wakeUp ()
+    {
+        packetAdded.signal ();
+    }
+
+    /** Returns the number of packets waiting to be decoded */
+    int getNumPackets () const
+    {
+        const juce::ScopedLock lock (queueLock);
+        return static_cast<int> (packets.size());
+    }
+
+    /** Returns the number of bytes of all packets waiting to be decoded */
+    juce::int64 getTotalSize () const
+    {
+        const juce::ScopedLock lock (queueLock);
+        return totalSize;
+    }
+
+    /** Drops all packets, e.g. after seeking */
+    void clear ()
+    {
+        const juce::ScopedLock lock (queueLock);
+        for (auto& queued : packets)
+            av_packet_free (&queued.first);
+        packets.clear();
+        totalSize = 0;
+    }
+
+private:
+    juce::CriticalSection       queueLock;
+
+    std::deque<std::pair<AVPacket*, int> > packets;
+
+    juce::int64                 totalSize;
+
+    juce::WaitableEvent         packetAdded;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegPacketQueue)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGPACKETQUEUE_H_INCLUDED */
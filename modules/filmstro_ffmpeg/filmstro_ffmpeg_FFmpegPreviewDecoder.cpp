@@ -0,0 +1,358 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegPreviewDecoder
+ \file         filmstro_ffmpeg_FFmpegPreviewDecoder.cpp
+ \brief        Decodes single preview pictures independently of the playback
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  A lightweight decoder with its own format context, that renders
+               preview images e.g. for hovering over a position slider. It never
+               touches the FFmpegVideoReader used for playback.
+
+ ==============================================================================
+ */
+
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+FFmpegPreviewDecoder::FFmpegPreviewDecoder ()
+  : juce::Thread        ("FFmpeg preview"),
+    needsOpening        (false),
+    hasRequest          (false),
+    requestedSeconds    (0.0),
+    requestedExact      (false),
+    requestCounter      (0),
+    formatContext       (nullptr),
+    videoContext        (nullptr),
+    videoStreamIdx      (-1),
+    previewWidth        (240),
+    previewHeight       (135),
+    previewSizeChanged  (false),
+    scalerSourceWidth   (0),
+    scalerSourceHeight  (0),
+    scalerSourceFormat  (AV_PIX_FMT_NONE),
+    scalerWidth         (0),
+    scalerHeight        (0)
+{
+    av_register_all();
+    startThread (3);
+}
+
+FFmpegPreviewDecoder::~FFmpegPreviewDecoder ()
+{
+    ++requestCounter;
+    stopThread (1000);
+    closeFile ();
+}
+
+void FFmpegPreviewDecoder::openMovieFile (const File& file)
+{
+    {
+        const ScopedLock lock (requestLock);
+        fileToOpen   = file;
+        needsOpening = true;
+        hasRequest   = false;
+        ++requestCounter;
+    }
+    notify();
+}
+
+void FFmpegPreviewDecoder::closeMovieFile ()
+{
+    openMovieFile (File());
+}
+
+void FFmpegPreviewDecoder::setPreviewSize (const int width, const int height)
+{
+    previewWidth  = jmax (1, width);
+    previewHeight = jmax (1, height);
+    // the kept keyframes belong to the preview thread, it drops them before the next preview
+    previewSizeChanged = true;
+}
+
+void FFmpegPreviewDecoder::requestPreview (const double seconds, const bool exactFrame)
+{
+    {
+        const ScopedLock lock (requestLock);
+        requestedSeconds = seconds;
+        requestedExact   = exactFrame;
+        hasRequest       = true;
+        ++requestCounter;
+    }
+    notify();
+}
+
+void FFmpegPreviewDecoder::cancelPreview ()
+{
+    {
+        const ScopedLock lock (requestLock);
+        hasRequest = false;
+        ++requestCounter;
+    }
+}
+
+void FFmpegPreviewDecoder::addListener (Listener* listener)
+{
+    listeners.add (listener);
+}
+
+void FFmpegPreviewDecoder::removeListener (Listener* listener)
+{
+    listeners.remove (listener);
+}
+
+void FFmpegPreviewDecoder::run ()
+{
+    while (! threadShouldExit()) {
+        File file;
+        bool open = false;
+        bool decode = false;
+        double seconds = 0.0;
+        bool exact = false;
+        juce::uint32 requestId = 0;
+        {
+            const ScopedLock lock (requestLock);
+            open = needsOpening;
+            file = fileToOpen;
+            needsOpening = false;
+
+            decode = hasRequest;
+            seconds = requestedSeconds;
+            exact = requestedExact;
+            hasRequest = false;
+            requestId = requestCounter;
+        }
+
+        if (open) {
+            closeFile ();
+            if (file != File()) {
+                openFile (file);
+            }
+        }
+
+        if (decode && formatContext != nullptr) {
+            decodePreview (seconds, exact, requestId);
+        }
+
+        if (! decode && ! open) {
+            wait (500);
+        }
+    }
+}
+
+bool FFmpegPreviewDecoder::openFile (const File& file)
+{
+    if (avformat_open_input (&formatContext, file.getFullPathName().toRawUTF8(), NULL, NULL) < 0) {
+        DBG ("Preview: opening " + file.getFileName() + " failed");
+        return false;
+    }
+
+    if (avformat_find_stream_info (formatContext, NULL) < 0) {
+        closeFile ();
+        return false;
+    }
+
+    AVCodec* codec = nullptr;
+    videoStreamIdx = av_find_best_stream (formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (videoStreamIdx < 0 || codec == nullptr) {
+        closeFile ();
+        return false;
+    }
+
+    for (unsigned int i=0; i < formatContext->nb_streams; ++i)
+        formatContext->streams [i]->discard = static_cast<int> (i) == videoStreamIdx ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+
+    videoContext = avcodec_alloc_context3 (codec);
+    avcodec_parameters_to_context (videoContext, formatContext->streams [videoStreamIdx]->codecpar);
+    // a single thread returns the picture with the packet, and leaves the cores to the playback
+    videoContext->thread_count = 1;
+    framePool->useForDecoder (videoContext, codec);
+    if (avcodec_open2 (videoContext, codec, NULL) < 0) {
+        DBG ("Preview: failed to open codec");
+        closeFile ();
+        return false;
+    }
+    return true;
+}
+
+void FFmpegPreviewDecoder::closeFile ()
+{
+    keyframes.clear();
+    if (videoContext) {
+        avcodec_free_context (&videoContext);
+    }
+    if (formatContext) {
+        avformat_close_input (&formatContext);
+    }
+    videoStreamIdx = -1;
+}
+
+bool FFmpegPreviewDecoder::isAborted (const juce::uint32 requestId) const
+{
+    return threadShouldExit() || requestCounter != requestId;
+}
+
+bool FFmpegPreviewDecoder::decodePreview (const double seconds, const bool exactFrame, const juce::uint32 requestId)
+{
+    const int maxKeptKeyframes = 32;
+
+    if (previewSizeChanged.exchange (false))
+        keyframes.clear();
+
+    // the seek bar counts from the start of the file, e.g. MPEG-TS doesn't start at zero
+    const int64_t start = formatContext->start_time != AV_NOPTS_VALUE ? formatContext->start_time : 0;
+    const double startSeconds = static_cast<double> (start) / AV_TIME_BASE;
+
+    if (av_seek_frame (formatContext, -1, start + static_cast<int64_t> (seconds * AV_TIME_BASE), AVSEEK_FLAG_BACKWARD) < 0)
+        return false;
+
+    avcodec_flush_buffers (videoContext);
+
+    // for the keyframe neither the demuxer nor the codec need to look at the other frames
+    AVStream* stream = formatContext->streams [videoStreamIdx];
+    stream->discard          = exactFrame ? AVDISCARD_DEFAULT : AVDISCARD_NONKEY;
+    videoContext->skip_frame = exactFrame ? AVDISCARD_DEFAULT : AVDISCARD_NONKEY;
+
+    const AVRational timeBase = stream->time_base;
+    const double fps = av_q2d (av_guess_frame_rate (formatContext, stream, NULL));
+    const double frameDuration = fps > 0.0 ? 1.0 / fps : 0.0;
+
+    AVPacket packet;
+    packet.data = NULL;
+    packet.size = 0;
+    av_init_packet (&packet);
+
+    AVFrame* frame = framePool->acquireFrame();
+    juce::int64 keyPTS = AV_NOPTS_VALUE;
+    bool done = false;
+
+    while (! done && ! isAborted (requestId)) {
+        if (av_read_frame (formatContext, &packet) < 0) {
+            // end of file, drain the codec
+            avcodec_send_packet (videoContext, NULL);
+        }
+        else if (packet.stream_index != videoStreamIdx) {
+            av_packet_unref (&packet);
+            continue;
+        }
+        else {
+            if (packet.flags & AV_PKT_FLAG_KEY) {
+                keyPTS = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+                if (! exactFrame) {
+                    // the keyframe was shown recently, no need to decode it
+                    for (auto it = keyframes.begin(); it != keyframes.end(); ++it) {
+                        if (it->pts == keyPTS) {
+                            const Keyframe keyframe = *it;
+                            keyframes.erase (it);
+                            keyframes.push_front (keyframe);
+                            listeners.call (&Listener::previewReady, keyframe.image, keyframe.seconds);
+                            done = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (! done) {
+                avcodec_send_packet (videoContext, &packet);
+            }
+            av_packet_unref (&packet);
+        }
+
+        while (! done) {
+            const int response = avcodec_receive_frame (videoContext, frame);
+            if (response == AVERROR_EOF) {
+                done = true;
+                break;
+            }
+            if (response < 0)
+                break;
+
+            const int64_t pts = av_frame_get_best_effort_timestamp (frame);
+            const double frameSeconds = av_q2d (timeBase) * pts - startSeconds;
+            if (exactFrame && frameSeconds + frameDuration <= seconds) {
+                // not there yet
+                av_frame_unref (frame);
+                continue;
+            }
+
+            Image image = createImage (frame);
+            if (! exactFrame && keyPTS != AV_NOPTS_VALUE) {
+                keyframes.push_front ({keyPTS, frameSeconds, image});
+                if (keyframes.size() > static_cast<size_t> (maxKeptKeyframes))
+                    keyframes.pop_back();
+            }
+            av_frame_unref (frame);
+
+            if (! isAborted (requestId)) {
+                listeners.call (&Listener::previewReady, image, frameSeconds);
+            }
+            done = true;
+        }
+    }
+
+    framePool->releaseFrame (frame);
+    return done && ! isAborted (requestId);
+}
+
+Image FFmpegPreviewDecoder::createImage (const AVFrame* frame)
+{
+    if (frame->width <= 0 || frame->height <= 0)
+        return Image();
+
+    double aspect = static_cast<double> (frame->width) / frame->height;
+    if (frame->sample_aspect_ratio.num > 0)
+        aspect *= av_q2d (frame->sample_aspect_ratio);
+
+    int width  = previewWidth;
+    int height = roundToInt (width / aspect);
+    if (height > previewHeight) {
+        height = previewHeight;
+        width  = roundToInt (height * aspect);
+    }
+    width  = jmax (1, width);
+    height = jmax (1, height);
+
+    if (frame->width != scalerSourceWidth || frame->height != scalerSourceHeight || frame->format != scalerSourceFormat ||
+        width != scalerWidth || height != scalerHeight) {
+        scaler.setupScaler (frame->width, frame->height, static_cast<AVPixelFormat> (frame->format),
+                            width, height, AV_PIX_FMT_BGR0);
+        scalerSourceWidth  = frame->width;
+        scalerSourceHeight = frame->height;
+        scalerSourceFormat = frame->format;
+        scalerWidth  = width;
+        scalerHeight = height;
+    }
+
+    // each preview gets a new image, so the receiver can keep it
+    Image image (Image::ARGB, width, height, false);
+    scaler.convertFrameToImage (image, frame);
+    return image;
+}
@@ -0,0 +1,156 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegPreviewDecoder
+ \file         filmstro_ffmpeg_FFmpegPreviewDecoder.h
+ \brief        Decodes single preview pictures independently of the playback
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  A lightweight decoder with its own format context, that renders
+               preview images e.g. for hovering over a position slider. It never
+               touches the FFmpegVideoReader used for playback.
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGPREVIEWDECODER_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGPREVIEWDECODER_H_INCLUDED
+
+#include <atomic>
+#include <deque>
+
+/**
+ \class         FFmpegPreviewDecoder
+ \description   Serves preview images of arbitrary positions
+
+ Only the latest request is served. A new request or cancelPreview aborts the
+ one in progress. Unless an exact frame is requested, the keyframe before the
+ position is shown. The last decoded keyframes are kept, so hovering back and
+ forth within a GOP doesn't decode again.
+ */
+class FFmpegPreviewDecoder : public juce::Thread
+{
+public:
+    /**
+     \class         FFmpegPreviewDecoder::Listener
+     \description   Receives the preview images
+     */
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        /** Called from the preview thread, when the image for a request is ready.
+         seconds is the presentation time of the shown frame, counted from the start of the file */
+        virtual void previewReady (const juce::Image& image, const double seconds) = 0;
+    };
+
+    FFmpegPreviewDecoder ();
+    virtual ~FFmpegPreviewDecoder ();
+
+    /** Opens a file for previews. This returns immediately, the file is opened on the preview thread */
+    void openMovieFile (const juce::File& file);
+
+    /** Closes the file and drops all kept images */
+    void closeMovieFile ();
+
+    /** Set the maximum size of the preview images. The images keep the video's aspect ratio */
+    void setPreviewSize (const int width, const int height);
+
+    /** Requests a preview of the position in seconds from the start of the file. A pending request is replaced */
+    void requestPreview (const double seconds, const bool exactFrame = false);
+
+    /** Drops the pending request and aborts the one in progress */
+    void cancelPreview ();
+
+    void addListener (Listener* listener);
+
+    void removeListener (Listener* listener);
+
+    /** working loop */
+    void run() override;
+
+private:
+    /** opens the format context and the decoder for the file set in openMovieFile */
+    bool openFile (const juce::File& file);
+
+    void closeFile ();
+
+    /** Decodes the image for seconds. Returns false if the request was aborted */
+    bool decodePreview (const double seconds, const bool exactFrame, const juce::uint32 requestId);
+
+    /** scales the frame to the preview size */
+    juce::Image createImage (const AVFrame* frame);
+
+    bool isAborted (const juce::uint32 requestId) const;
+
+    juce::CriticalSection       requestLock;
+    juce::File                  fileToOpen;
+    bool                        needsOpening;
+    bool                        hasRequest;
+    double                      requestedSeconds;
+    bool                        requestedExact;
+
+    /** increments with each request and cancel, so older requests notice they are outdated */
+    std::atomic<juce::uint32>   requestCounter;
+
+    AVFormatContext*            formatContext;
+    AVCodecContext*             videoContext;
+    int                         videoStreamIdx;
+
+    struct Keyframe
+    {
+        juce::int64 pts;
+        double      seconds;
+        juce::Image image;
+    };
+
+    /** the last decoded keyframes, most recent first */
+    std::deque<Keyframe>        keyframes;
+
+    std::atomic<int>            previewWidth;
+    std::atomic<int>            previewHeight;
+    std::atomic<bool>           previewSizeChanged;
+
+    FFmpegVideoScaler           scaler;
+    int                         scalerSourceWidth;
+    int                         scalerSourceHeight;
+    int                         scalerSourceFormat;
+    int                         scalerWidth;
+    int                         scalerHeight;
+
+    juce::ListenerList<Listener> listeners;
+
+    juce::SharedResourcePointer<FFmpegFramePool> framePool;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegPreviewDecoder)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGPREVIEWDECODER_H_INCLUDED */
@@ -0,0 +1,219 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegSeekIndex
+ \file         filmstro_ffmpeg_FFmpegSeekIndex.cpp
+ \brief        An index of the keyframes in a video file
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  Scans the packets of a stream in the background to find the
+               keyframes, so a seek can go straight to the keyframe before
+               the target.
+
+ ==============================================================================
+ */
+
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+FFmpegSeekIndex::FFmpegSeekIndex ()
+  : juce::Thread    ("FFmpeg seek index"),
+    indexedStream   (-1),
+    ready           (false)
+{
+}
+
+FFmpegSeekIndex::~FFmpegSeekIndex ()
+{
+    stopThread (1000);
+}
+
+void FFmpegSeekIndex::buildIndex (const juce::File& file, const int streamIndex)
+{
+    clear ();
+
+    indexedFile   = file;
+    indexedStream = streamIndex;
+
+    if (indexedStream >= 0)
+        startThread (3);
+}
+
+void FFmpegSeekIndex::setKeyframes (const int streamIndex, const std::vector<Entry>& keyframes)
+{
+    clear ();
+
+    {
+        const ScopedLock lock (indexLock);
+        entries       = keyframes;
+        indexedStream = streamIndex;
+    }
+    buildLookupTable ();
+    ready = true;
+}
+
+std::vector<FFmpegSeekIndex::Entry> FFmpegSeekIndex::getKeyframes () const
+{
+    const ScopedLock lock (indexLock);
+    return entries;
+}
+
+void FFmpegSeekIndex::addListener (Listener* listener)
+{
+    listeners.add (listener);
+}
+
+void FFmpegSeekIndex::removeListener (Listener* listener)
+{
+    listeners.remove (listener);
+}
+
+void FFmpegSeekIndex::clear ()
+{
+    stopThread (1000);
+
+    const ScopedLock lock (indexLock);
+    ready = false;
+    entries.clear();
+    secondsLookup.clear();
+    indexedStream = -1;
+}
+
+bool FFmpegSeekIndex::isReady () const
+{
+    return ready;
+}
+
+int FFmpegSeekIndex::getNumKeyframes () const
+{
+    const ScopedLock lock (indexLock);
+    return static_cast<int> (entries.size());
+}
+
+int FFmpegSeekIndex::getStreamIndex () const
+{
+    return indexedStream;
+}
+
+bool FFmpegSeekIndex::findKeyframe (const double seconds, Entry& keyframe) const
+{
+    if (! ready)
+        return false;
+
+    const ScopedLock lock (indexLock);
+    if (entries.empty())
+        return false;
+
+    // jump to the keyframe of the full second, then walk the few keyframes within that second
+    const int second = jlimit (0, static_cast<int> (secondsLookup.size()) - 1, static_cast<int> (seconds));
+    int index = jmax (0, secondsLookup [second]);
+    while (index + 1 < static_cast<int> (entries.size()) && entries [index + 1].seconds <= seconds)
+        ++index;
+
+    keyframe = entries [index];
+    return true;
+}
+
+void FFmpegSeekIndex::run ()
+{
+    AVFormatContext* context = nullptr;
+    if (avformat_open_input (&context, indexedFile.getFullPathName().toRawUTF8(), NULL, NULL) < 0) {
+        DBG ("Seek index: opening file failed");
+        return;
+    }
+
+    // some containers only announce their streams after probing
+    if (! isPositiveAndBelow (indexedStream, static_cast<int> (context->nb_streams)))
+        avformat_find_stream_info (context, NULL);
+
+    if (! isPositiveAndBelow (indexedStream, static_cast<int> (context->nb_streams))) {
+        avformat_close_input (&context);
+        return;
+    }
+
+    // let the demuxer skip all other streams and, if it supports that, the non key packets
+    for (unsigned int i=0; i < context->nb_streams; ++i)
+        context->streams [i]->discard = static_cast<int> (i) == indexedStream ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+
+    const AVRational timeBase = context->streams [indexedStream]->time_base;
+
+    AVPacket packet;
+    packet.data = NULL;
+    packet.size = 0;
+    av_init_packet (&packet);
+
+    while (!threadShouldExit() && av_read_frame (context, &packet) >= 0) {
+        if (packet.stream_index == indexedStream && (packet.flags & AV_PKT_FLAG_KEY)) {
+            const int64_t timestamp = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+            if (timestamp != AV_NOPTS_VALUE) {
+                Entry entry;
+                entry.pos     = packet.pos;
+                entry.pts     = packet.pts;
+                entry.dts     = packet.dts;
+                entry.seconds = av_q2d (timeBase) * timestamp;
+
+                const ScopedLock lock (indexLock);
+                entries.push_back (entry);
+            }
+        }
+        av_packet_unref (&packet);
+    }
+
+    avformat_close_input (&context);
+
+    if (! threadShouldExit()) {
+        buildLookupTable ();
+        ready = true;
+        DBG ("Seek index: found " + String (getNumKeyframes()) + " keyframes");
+
+        listeners.call (&Listener::seekIndexReady, *this);
+    }
+}
+
+void FFmpegSeekIndex::buildLookupTable ()
+{
+    const ScopedLock lock (indexLock);
+
+    std::sort (entries.begin(), entries.end(), [] (const Entry& a, const Entry& b) { return a.seconds < b.seconds; });
+
+    secondsLookup.clear();
+    if (entries.empty())
+        return;
+
+    const int numSeconds = jmax (0, static_cast<int> (entries.back().seconds)) + 1;
+    secondsLookup.resize (static_cast<size_t> (numSeconds), -1);
+
+    int index = -1;
+    for (int second = 0; second < numSeconds; ++second) {
+        while (index + 1 < static_cast<int> (entries.size()) && entries [index + 1].seconds <= second)
+            ++index;
+        secondsLookup [second] = index;
+    }
+}
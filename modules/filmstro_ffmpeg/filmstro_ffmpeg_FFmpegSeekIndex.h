@@ -0,0 +1,138 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegSeekIndex
+ \file         filmstro_ffmpeg_FFmpegSeekIndex.h
+ \brief        An index of the keyframes in a video file
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  Scans the packets of a stream in the background to find the
+               keyframes, so a seek can go straight to the keyframe before
+               the target.
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGSEEKINDEX_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGSEEKINDEX_H_INCLUDED
+
+/**
+ \class         FFmpegSeekIndex
+ \description   Keyframe index of one stream of a video file
+
+ The index opens its own format context and reads only the packet headers of
+ the indexed stream, no packet is decoded. Lookups are possible once the scan
+ has finished.
+ */
+class FFmpegSeekIndex : public juce::Thread
+{
+public:
+    /** A keyframe of the indexed stream. Timestamps are in the stream's time_base */
+    struct Entry
+    {
+        juce::int64 pos;
+        juce::int64 pts;
+        juce::int64 dts;
+        /** presentation time in seconds */
+        double      seconds;
+    };
+
+    /**
+     \class         FFmpegSeekIndex::Listener
+     \description   Get notified when the scan finished
+     */
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        /** Called from the scanning thread when the index is ready */
+        virtual void seekIndexReady (FFmpegSeekIndex&) = 0;
+    };
+
+    FFmpegSeekIndex ();
+    virtual ~FFmpegSeekIndex ();
+
+    /** Starts scanning the stream in the background. A previous index is dropped. */
+    void buildIndex (const juce::File& file, const int streamIndex);
+
+    /** Sets keyframes from a previous scan, e.g. from the FFmpegIndexCache. The index
+     is ready immediately and the listeners are not called. */
+    void setKeyframes (const int streamIndex, const std::vector<Entry>& keyframes);
+
+    /** Returns a copy of all keyframes */
+    std::vector<Entry> getKeyframes () const;
+
+    void addListener (Listener* listener);
+
+    void removeListener (Listener* listener);
+
+    /** Stops scanning and drops the index */
+    void clear ();
+
+    /** Returns true, once the scan finished and the index can be used */
+    bool isReady () const;
+
+    /** Finds the last keyframe with a presentation time at or before seconds.
+     Returns false, if the index is not ready or empty. */
+    bool findKeyframe (const double seconds, Entry& keyframe) const;
+
+    /** Returns the number of indexed keyframes */
+    int getNumKeyframes () const;
+
+    /** Returns the stream the index was built for */
+    int getStreamIndex () const;
+
+    /** working loop */
+    void run() override;
+
+private:
+    /** Builds the table to look up a keyframe by the full second */
+    void buildLookupTable ();
+
+    juce::CriticalSection       indexLock;
+
+    std::vector<Entry>          entries;
+
+    /** index into entries of the last keyframe at or before each full second */
+    std::vector<int>            secondsLookup;
+
+    juce::File                  indexedFile;
+
+    int                         indexedStream;
+
+    std::atomic<bool>           ready;
+
+    juce::ListenerList<Listener> listeners;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegSeekIndex)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGSEEKINDEX_H_INCLUDED */
@@ -0,0 +1,413 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegThumbnailGenerator
+ \file         filmstro_ffmpeg_FFmpegThumbnailGenerator.cpp
+ \brief        Creates a strip of thumbnails of a video file
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  Decodes only the keyframes next to evenly spaced positions,
+               using several format contexts on a thread pool, and caches the
+               strips as image atlas on disk.
+
+ ==============================================================================
+ */
+
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+// ==============================================================================
+// segment job
+// ==============================================================================
+
+/**
+ Decodes the thumbnails firstIndex to lastIndex - 1 of a strip with its own format context
+ */
+class FFmpegThumbnailGenerator::SegmentJob : public juce::ThreadPoolJob
+{
+public:
+    SegmentJob (FFmpegThumbnailGenerator& ownerToUse, Strip::Ptr stripToFill, const int first, const int last)
+      : juce::ThreadPoolJob ("FFmpeg thumbnails"),
+        owner       (ownerToUse),
+        strip       (stripToFill),
+        firstIndex  (first),
+        lastIndex   (last)
+    {}
+
+    JobStatus runJob () override
+    {
+        const int numDecoded = strip->cancelled ? 0 : decodeThumbnails ();
+        strip->numFailed += (lastIndex - firstIndex) - numDecoded;
+
+        if (--strip->numSegmentsRunning == 0) {
+            owner.stripFinished (strip);
+        }
+        return jobHasFinished;
+    }
+
+private:
+    /** Returns the number of thumbnails drawn into the atlas */
+    int decodeThumbnails ()
+    {
+        int numDecoded = 0;
+        AVFormatContext* context = nullptr;
+        if (avformat_open_input (&context, strip->mediaFile.getFullPathName().toRawUTF8(), NULL, NULL) < 0) {
+            DBG ("Thumbnails: opening " + strip->mediaFile.getFileName() + " failed");
+            return numDecoded;
+        }
+
+        AVCodecContext* codecContext = nullptr;
+        const int streamIndex = openVideoDecoder (context, &codecContext);
+        if (streamIndex >= 0) {
+            AVFrame* frame = framePool->acquireFrame();
+            const double duration = context->duration > 0 ? static_cast<double> (context->duration) / AV_TIME_BASE : 0.0;
+
+            for (int i = firstIndex; i < lastIndex && ! shouldExit() && ! strip->cancelled; ++i) {
+                // the middle of the section the thumbnail stands for
+                const double seconds = (i + 0.5) * duration / strip->numThumbnails;
+                if (decodeKeyframe (context, codecContext, streamIndex, seconds, frame) &&
+                    drawIntoAtlas (frame, i, codecContext->sample_aspect_ratio)) {
+                    ++numDecoded;
+                }
+                av_frame_unref (frame);
+            }
+
+            framePool->releaseFrame (frame);
+            avcodec_free_context (&codecContext);
+        }
+
+        avformat_close_input (&context);
+        return numDecoded;
+    }
+
+    /** Opens a single threaded decoder for the video stream, that only outputs keyframes */
+    int openVideoDecoder (AVFormatContext* context, AVCodecContext** codecContext)
+    {
+        if (avformat_find_stream_info (context, NULL) < 0)
+            return -1;
+
+        AVCodec* codec = nullptr;
+        const int streamIndex = av_find_best_stream (context, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+        if (streamIndex < 0 || codec == nullptr)
+            return -1;
+
+        for (unsigned int i=0; i < context->nb_streams; ++i)
+            context->streams [i]->discard = static_cast<int> (i) == streamIndex ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+
+        *codecContext = avcodec_alloc_context3 (codec);
+        if (*codecContext == nullptr)
+            return -1;
+
+        AVCodecContext* ctx = *codecContext;
+        avcodec_parameters_to_context (ctx, context->streams [streamIndex]->codecpar);
+        ctx->skip_frame   = AVDISCARD_NONKEY;
+        // the segments already run in parallel, and a single thread returns the frame without delay
+        ctx->thread_count = 1;
+
+        // decode in a lower resolution, as long as it is still bigger than the thumbnail
+        int lowres = 0;
+        while (lowres < codec->max_lowres &&
+               (ctx->width  >> (lowres + 1)) >= strip->thumbnailWidth &&
+               (ctx->height >> (lowres + 1)) >= strip->thumbnailHeight)
+            ++lowres;
+        ctx->lowres = lowres;
+        framePool->useForDecoder (ctx, codec);
+
+        if (avcodec_open2 (ctx, codec, NULL) < 0) {
+            DBG ("Thumbnails: failed to open codec");
+            avcodec_free_context (codecContext);
+            return -1;
+        }
+        return streamIndex;
+    }
+
+    /** Seeks to the keyframe before seconds and decodes it */
+    bool decodeKeyframe (AVFormatContext* context, AVCodecContext* codecContext, const int streamIndex,
+                         const double seconds, AVFrame* frame)
+    {
+        // the positions count from the start of the file, e.g. MPEG-TS doesn't start at zero
+        const int64_t start = context->start_time != AV_NOPTS_VALUE ? context->start_time : 0;
+        if (av_seek_frame (context, -1, start + static_cast<int64_t> (seconds * AV_TIME_BASE), AVSEEK_FLAG_BACKWARD) < 0)
+            return false;
+
+        avcodec_flush_buffers (codecContext);
+
+        AVPacket packet;
+        packet.data = NULL;
+        packet.size = 0;
+        av_init_packet (&packet);
+
+        // the demuxer returns only key packets, so the first decodable one is close
+        const int maxPackets = 32;
+        for (int i = 0; i < maxPackets && ! shouldExit(); ++i) {
+            if (av_read_frame (context, &packet) < 0)
+                break;
+
+            const bool sent = packet.stream_index == streamIndex && avcodec_send_packet (codecContext, &packet) >= 0;
+            av_packet_unref (&packet);
+
+            if (sent && avcodec_receive_frame (codecContext, frame) >= 0)
+                return true;
+        }
+
+        // end of file, drain what the codec still holds
+        if (avcodec_send_packet (codecContext, NULL) >= 0 && avcodec_receive_frame (codecContext, frame) >= 0)
+            return true;
+
+        return false;
+    }
+
+    bool drawIntoAtlas (const AVFrame* frame, const int index, const AVRational sampleAspect)
+    {
+        if (frame->width <= 0 || frame->height <= 0)
+            return false;
+
+        const double pixelAspect = sampleAspect.num > 0 ? av_q2d (sampleAspect) : 1.0;
+        const juce::Rectangle<int> cell = getThumbnailBounds (strip->atlas, index, strip->numThumbnails);
+        const juce::Rectangle<int> area = juce::RectanglePlacement (juce::RectanglePlacement::centred)
+                                          .appliedTo (juce::Rectangle<double> (frame->width * pixelAspect, frame->height),
+                                                      cell.toDouble()).getSmallestIntegerContainer()
+                                          .getIntersection (cell);
+        if (area.isEmpty())
+            return false;
+
+        if (thumbnail.getWidth() != area.getWidth() || thumbnail.getHeight() != area.getHeight() ||
+            frame->width != scaledWidth || frame->height != scaledHeight || frame->format != scaledFormat) {
+            thumbnail = juce::Image (juce::Image::ARGB, area.getWidth(), area.getHeight(), false);
+            scaler.setupScaler (frame->width, frame->height, static_cast<AVPixelFormat> (frame->format),
+                                area.getWidth(), area.getHeight(), AV_PIX_FMT_BGR0);
+            scaledWidth  = frame->width;
+            scaledHeight = frame->height;
+            scaledFormat = frame->format;
+        }
+        scaler.convertFrameToImage (thumbnail, frame);
+
+        // the segments write into different cells, so they don't need to lock the atlas
+        const juce::Image::BitmapData source (thumbnail, juce::Image::BitmapData::readOnly);
+        const juce::Image::BitmapData dest (strip->atlas, area.getX(), area.getY(), area.getWidth(), area.getHeight(),
+                                            juce::Image::BitmapData::writeOnly);
+        for (int y = 0; y < area.getHeight(); ++y) {
+            uint8* destLine = dest.getLinePointer (y);
+            memcpy (destLine, source.getLinePointer (y), static_cast<size_t> (area.getWidth() * source.pixelStride));
+            // BGR0 leaves the alpha channel undefined
+            for (int x = 0; x < area.getWidth(); ++x)
+                destLine [x * dest.pixelStride + 3] = 0xff;
+        }
+        return true;
+    }
+
+    FFmpegThumbnailGenerator&   owner;
+    Strip::Ptr                  strip;
+    const int                   firstIndex;
+    const int                   lastIndex;
+
+    FFmpegVideoScaler           scaler;
+    juce::Image                 thumbnail;
+    int                         scaledWidth  = 0;
+    int                         scaledHeight = 0;
+    int                         scaledFormat = -1;
+
+    juce::SharedResourcePointer<FFmpegFramePool> framePool;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SegmentJob)
+};
+
+// ==============================================================================
+// strip
+// ==============================================================================
+
+FFmpegThumbnailGenerator::Strip::Strip (const File& file, const int num, const int width, const int height, const int numSegments)
+  : mediaFile           (file),
+    numThumbnails       (num),
+    thumbnailWidth      (width),
+    thumbnailHeight     (height),
+    atlas               (Image::ARGB, width * num, height, true),
+    numSegmentsRunning  (numSegments),
+    numFailed           (0),
+    cancelled           (false)
+{
+}
+
+// ==============================================================================
+// generator
+// ==============================================================================
+
+FFmpegThumbnailGenerator::FFmpegThumbnailGenerator (const int numThreads)
+  : pool                (jmax (1, numThreads)),
+    thumbnailWidth      (160),
+    thumbnailHeight     (90),
+    numSegmentsPerFile  (jmax (1, numThreads))
+{
+    av_register_all();
+}
+
+FFmpegThumbnailGenerator::~FFmpegThumbnailGenerator ()
+{
+    cancelAll ();
+}
+
+void FFmpegThumbnailGenerator::setThumbnailSize (const int width, const int height)
+{
+    thumbnailWidth  = jmax (1, width);
+    thumbnailHeight = jmax (1, height);
+}
+
+void FFmpegThumbnailGenerator::setNumSegmentsPerFile (const int numSegments)
+{
+    numSegmentsPerFile = jmax (1, numSegments);
+}
+
+void FFmpegThumbnailGenerator::setCacheDirectory (const File& directory)
+{
+    cacheDirectory = directory;
+}
+
+void FFmpegThumbnailGenerator::generateThumbnails (const File& mediaFile, const int numThumbnails)
+{
+    if (numThumbnails < 1 || ! mediaFile.existsAsFile())
+        return;
+
+    Image cached = getCachedThumbnails (mediaFile, numThumbnails);
+    if (cached.isValid()) {
+        listeners.call (&Listener::thumbnailsReady, mediaFile, cached, numThumbnails);
+        return;
+    }
+
+    const int numSegments = jmin (numSegmentsPerFile, numThumbnails);
+    Strip::Ptr strip = new Strip (mediaFile, numThumbnails, thumbnailWidth, thumbnailHeight, numSegments);
+    {
+        const ScopedLock lock (stripsLock);
+        strips.add (strip);
+    }
+
+    // each segment reads a contiguous part of the file
+    for (int segment = 0; segment < numSegments; ++segment) {
+        const int first = segment * numThumbnails / numSegments;
+        const int last  = (segment + 1) * numThumbnails / numSegments;
+        pool.addJob (new SegmentJob (*this, strip, first, last), true);
+    }
+}
+
+Image FFmpegThumbnailGenerator::getCachedThumbnails (const File& mediaFile, const int numThumbnails) const
+{
+    if (cacheDirectory == File())
+        return Image();
+
+    const File cacheFile = getCacheFile (mediaFile, numThumbnails, thumbnailWidth, thumbnailHeight);
+    if (! cacheFile.existsAsFile() || cacheFile.getLastModificationTime() < mediaFile.getLastModificationTime())
+        return Image();
+
+    return ImageFileFormat::loadFrom (cacheFile);
+}
+
+void FFmpegThumbnailGenerator::cancelThumbnails (const File& mediaFile)
+{
+    const ScopedLock lock (stripsLock);
+    for (int i = strips.size(); --i >= 0;) {
+        if (strips.getUnchecked (i)->mediaFile == mediaFile) {
+            strips.getUnchecked (i)->cancelled = true;
+            strips.remove (i);
+        }
+    }
+}
+
+void FFmpegThumbnailGenerator::cancelAll ()
+{
+    {
+        const ScopedLock lock (stripsLock);
+        for (auto* strip : strips)
+            strip->cancelled = true;
+        strips.clear();
+    }
+    pool.removeAllJobs (true, 2000);
+}
+
+Rectangle<int> FFmpegThumbnailGenerator::getThumbnailBounds (const Image& atlas, const int index, const int numThumbnails)
+{
+    if (numThumbnails < 1)
+        return Rectangle<int>();
+
+    const int width = atlas.getWidth() / numThumbnails;
+    return Rectangle<int> (index * width, 0, width, atlas.getHeight());
+}
+
+void FFmpegThumbnailGenerator::addListener (Listener* listener)
+{
+    listeners.add (listener);
+}
+
+void FFmpegThumbnailGenerator::removeListener (Listener* listener)
+{
+    listeners.remove (listener);
+}
+
+void FFmpegThumbnailGenerator::stripFinished (Strip::Ptr strip)
+{
+    {
+        const ScopedLock lock (stripsLock);
+        strips.removeObject (strip);
+    }
+
+    if (strip->cancelled)
+        return;
+
+    if (strip->numFailed > 0) {
+        // an incomplete strip is not cached, so the next request tries again
+        DBG ("Thumbnails: " + String (strip->numFailed.load()) + " of " + String (strip->numThumbnails) +
+             " thumbnails of " + strip->mediaFile.getFileName() + " failed");
+    }
+    else if (cacheDirectory != File() && cacheDirectory.createDirectory()) {
+        const File cacheFile = getCacheFile (strip->mediaFile, strip->numThumbnails,
+                                             strip->thumbnailWidth, strip->thumbnailHeight);
+        TemporaryFile temp (cacheFile);
+        bool written = false;
+        {
+            FileOutputStream output (temp.getFile());
+            PNGImageFormat png;
+            written = output.openedOk() && png.writeImageToStream (strip->atlas, output);
+            output.flush();
+            written = written && output.getStatus().wasOk();
+        }
+        if (! written || ! temp.overwriteTargetFileWithTemporary()) {
+            DBG ("Thumbnails: could not write " + cacheFile.getFullPathName());
+        }
+    }
+
+    listeners.call (&Listener::thumbnailsReady, strip->mediaFile, strip->atlas, strip->numThumbnails);
+}
+
+File FFmpegThumbnailGenerator::getCacheFile (const File& mediaFile, const int numThumbnails,
+                                             const int width, const int height) const
+{
+    const String key = String::toHexString (FFmpegIndexCache::calculatePartialHash (mediaFile)) + "_" +
+                       String::toHexString (mediaFile.getSize()) + "_" +
+                       String (numThumbnails) + "x" + String (width) + "x" + String (height);
+    return cacheDirectory.getChildFile (key).withFileExtension ("png");
+}
@@ -0,0 +1,159 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+ \class        FFmpegThumbnailGenerator
+ \file         filmstro_ffmpeg_FFmpegThumbnailGenerator.h
+ \brief        Creates a strip of thumbnails of a video file
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  Decodes only the keyframes next to evenly spaced positions,
+               using several format contexts on a thread pool, and caches the
+               strips as image atlas on disk.
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGTHUMBNAILGENERATOR_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGTHUMBNAILGENERATOR_H_INCLUDED
+
+#include <atomic>
+
+/**
+ \class         FFmpegThumbnailGenerator
+ \description   Generates thumbnail strips for many files without opening a FFmpegVideoReader
+
+ Each strip is split into segments. Every segment opens its own format context and
+ reads its part of the file, so the segments run in parallel on the thread pool.
+ The demuxer discards all non key packets, and where the codec supports it, the
+ pictures are decoded in a lower resolution.
+
+ A finished strip is one image with the thumbnails side by side, each in a cell of
+ the thumbnail size. If a cache directory is set, the strips are stored as PNG
+ and reused, as long as the media file doesn't change.
+ */
+class FFmpegThumbnailGenerator
+{
+public:
+    /**
+     \class         FFmpegThumbnailGenerator::Listener
+     \description   Receives the finished thumbnail strips
+     */
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        /** Called when all thumbnails of a file are done. This is called from a worker
+         thread, or from the calling thread, if the strip was found in the cache.
+         Use getThumbnailBounds to find a thumbnail in the atlas. The cells of thumbnails,
+         that failed to decode, stay transparent. */
+        virtual void thumbnailsReady (const juce::File& mediaFile, const juce::Image& atlas, const int numThumbnails) = 0;
+    };
+
+    /** Creates a generator with numThreads workers */
+    FFmpegThumbnailGenerator (const int numThreads = 4);
+
+    ~FFmpegThumbnailGenerator ();
+
+    /** Set the size of one cell in the atlas. The thumbnails are fitted into the cell
+     keeping their aspect ratio. Changing the size doesn't affect running jobs */
+    void setThumbnailSize (const int width, const int height);
+
+    /** Set the number of format contexts, that work on one file in parallel */
+    void setNumSegmentsPerFile (const int numSegments);
+
+    /** Set a directory to keep the generated strips */
+    void setCacheDirectory (const juce::File& directory);
+
+    /** Starts generating numThumbnails evenly spaced thumbnails of mediaFile. This
+     returns immediately, the listeners are called when the strip is done. */
+    void generateThumbnails (const juce::File& mediaFile, const int numThumbnails);
+
+    /** Returns the strip from the disk cache, or an invalid image if there is none */
+    juce::Image getCachedThumbnails (const juce::File& mediaFile, const int numThumbnails) const;
+
+    /** Stops generating the thumbnails of mediaFile, the listeners won't be called */
+    void cancelThumbnails (const juce::File& mediaFile);
+
+    /** Stops all jobs */
+    void cancelAll ();
+
+    /** Returns the area of the thumbnail with index in the atlas */
+    static juce::Rectangle<int> getThumbnailBounds (const juce::Image& atlas, const int index, const int numThumbnails);
+
+    void addListener (Listener* listener);
+
+    void removeListener (Listener* listener);
+
+private:
+    /** The atlas and the state of one file, shared by its segment jobs */
+    class Strip : public juce::ReferenceCountedObject
+    {
+    public:
+        typedef juce::ReferenceCountedObjectPtr<Strip> Ptr;
+
+        Strip (const juce::File& file, const int numThumbnails, const int width, const int height, const int numSegments);
+
+        const juce::File    mediaFile;
+        const int           numThumbnails;
+        const int           thumbnailWidth;
+        const int           thumbnailHeight;
+        juce::Image         atlas;
+
+        std::atomic<int>    numSegmentsRunning;
+        /** thumbnails, that could not be decoded, the strip is not cached then */
+        std::atomic<int>    numFailed;
+        std::atomic<bool>   cancelled;
+    };
+
+    class SegmentJob;
+
+    /** called by the last segment job of a strip */
+    void stripFinished (Strip::Ptr strip);
+
+    juce::File getCacheFile (const juce::File& mediaFile, const int numThumbnails,
+                             const int width, const int height) const;
+
+    juce::ThreadPool                    pool;
+
+    juce::CriticalSection               stripsLock;
+    juce::ReferenceCountedArray<Strip>  strips;
+
+    juce::ListenerList<Listener>        listeners;
+
+    juce::File                          cacheDirectory;
+    int                                 thumbnailWidth;
+    int                                 thumbnailHeight;
+    int                                 numSegmentsPerFile;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegThumbnailGenerator)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGTHUMBNAILGENERATOR_H_INCLUDED */
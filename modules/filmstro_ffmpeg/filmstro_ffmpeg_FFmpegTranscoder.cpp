@@ -0,0 +1,1116 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+
+ \class        FFmpegTranscoder
+ \file         filmstro_ffmpeg_FFmpegTranscoder.cpp
+ \brief        Connects a reader to a writer for offline processing
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  Runs exports as fast as decoding and encoding allow, without
+               being paced by the audio clock. Reports progress and throughput
+               and can be cancelled.
+
+ ==============================================================================
+ */
+
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+namespace
+{
+    /** minimum time between two progress callbacks */
+    const double progressInterval = 100.0;
+
+    AVCodecContext* openDecoder (const AVStream* stream, const int numThreads)
+    {
+        AVCodec* codec = avcodec_find_decoder (stream->codecpar->codec_id);
+        if (codec == nullptr)
+            return nullptr;
+
+        AVCodecContext* context = avcodec_alloc_context3 (codec);
+        avcodec_parameters_to_context (context, stream->codecpar);
+        context->pkt_timebase = stream->time_base;
+        context->thread_count = numThreads;
+        if (avcodec_open2 (context, codec, NULL) < 0) {
+            DBG ("Failed to open decoder for " + String (avcodec_get_name (stream->codecpar->codec_id)));
+            avcodec_free_context (&context);
+        }
+        return context;
+    }
+}
+
+// ==============================================================================
+// segment job
+// ==============================================================================
+
+/**
+ Encodes the video frames from startTs to endTs, or the whole audio, of the input
+ into a file of its own. Each job uses its own format contexts, decoder and writer.
+ */
+class FFmpegTranscoder::SegmentJob : public juce::ThreadPoolJob
+{
+public:
+    SegmentJob (FFmpegTranscoder& ownerToUse, const FFmpegVideoWriter& settings, const juce::File& output,
+                const AVMediaType typeToEncode, const int64_t start, const int64_t end, const int threads)
+      : juce::ThreadPoolJob ("FFmpeg segment"),
+        owner       (ownerToUse),
+        outputFile  (output),
+        type        (typeToEncode),
+        startTs     (start),
+        endTs       (end),
+        numThreads  (threads),
+        secondsDone (0.0),
+        succeeded   (false)
+    {
+        writer.copySettingsFrom (settings);
+        // the segments share the cores, the encoder shares its part with the decoder
+        writer.setThreadingOptions (jmax (1, numThreads - numThreads / 2));
+        // the segments only contain one media type each
+        if (type == AVMEDIA_TYPE_VIDEO)
+            writer.setAudioCodec (AV_CODEC_ID_NONE);
+        else
+            writer.setVideoCodec (AV_CODEC_ID_NONE);
+    }
+
+    JobStatus runJob () override
+    {
+        AVFormatContext* input = openInput (owner.inputFile);
+        if (input != nullptr) {
+            const int streamIdx = type == AVMEDIA_TYPE_VIDEO ? findVideoStream (input)
+                                                             : av_find_best_stream (input, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+            if (streamIdx >= 0 && writer.openMovieFile (outputFile, owner.outputFormat)) {
+                for (unsigned int i=0; i < input->nb_streams; ++i)
+                    input->streams [i]->discard = static_cast<int> (i) == streamIdx ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+
+                succeeded = type == AVMEDIA_TYPE_VIDEO ? encodeVideo (input, streamIdx) : encodeAudio (input, streamIdx);
+                writer.closeMovieFile();
+            }
+            avformat_close_input (&input);
+        }
+        if (! succeeded)
+            DBG ("Encoding the segment " + outputFile.getFileName() + " failed");
+
+        return jobHasFinished;
+    }
+
+    /** the seconds of media, this job has encoded */
+    double getSecondsDone () const { return secondsDone; }
+
+    bool hasSucceeded () const { return succeeded; }
+
+private:
+    bool shouldStop () const
+    {
+        return shouldExit() || owner.shouldStop();
+    }
+
+    bool encodeVideo (AVFormatContext* input, const int streamIdx)
+    {
+        const AVStream* stream = input->streams [streamIdx];
+        AVCodecContext* decoder = openDecoder (stream, jmax (1, numThreads / 2));
+        if (decoder == nullptr)
+            return false;
+
+        if (av_seek_frame (input, streamIdx, startTs, AVSEEK_FLAG_BACKWARD) < 0)
+            DBG ("Seeking to the segment failed, decoding from the start");
+
+        const AVRational timeBase = writer.getTimeBase (AVMEDIA_TYPE_VIDEO);
+        AVFrame* frame = av_frame_alloc();
+        int64_t lastPts = std::numeric_limits<int64_t>::min();
+        bool segmentDone = false;
+
+        auto receiveFrames = [&]
+        {
+            while (! segmentDone && avcodec_receive_frame (decoder, frame) >= 0) {
+                const int64_t pts = av_frame_get_best_effort_timestamp (frame);
+                if (pts != AV_NOPTS_VALUE && pts >= endTs) {
+                    // frames come in presentation order, the next segment starts here
+                    segmentDone = true;
+                }
+                else if (pts != AV_NOPTS_VALUE && pts >= startTs) {
+                    // each segment starts at zero, the concatenation moves them into place
+                    frame->pts = jmax (lastPts + 1, av_rescale_q (pts - startTs, stream->time_base, timeBase));
+                    lastPts = frame->pts;
+                    writer.displayNewFrame (frame);
+                    secondsDone = av_q2d (stream->time_base) * (pts - startTs);
+                }
+                av_frame_unref (frame);
+            }
+        };
+
+        AVPacket packet;
+        packet.data = NULL;
+        packet.size = 0;
+        av_init_packet (&packet);
+        while (! segmentDone && ! shouldStop() && av_read_frame (input, &packet) >= 0) {
+            if (packet.stream_index == streamIdx && avcodec_send_packet (decoder, &packet) >= 0)
+                receiveFrames();
+            av_packet_unref (&packet);
+        }
+
+        if (! segmentDone) {
+            // end of file, drain the decoder
+            avcodec_send_packet (decoder, NULL);
+            receiveFrames();
+        }
+
+        av_frame_free (&frame);
+        avcodec_free_context (&decoder);
+        return ! shouldStop();
+    }
+
+    bool encodeAudio (AVFormatContext* input, const int streamIdx)
+    {
+        const AVStream* stream = input->streams [streamIdx];
+        AVCodecContext* decoder = openDecoder (stream, 1);
+        if (decoder == nullptr)
+            return false;
+
+        const int sampleRate = writer.getSampleRate();
+        const int64_t inLayout = decoder->channel_layout != 0 ? decoder->channel_layout
+                                                              : av_get_default_channel_layout (decoder->channels);
+        SwrContext* resampler = swr_alloc_set_opts (NULL,
+                                                    AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLTP, sampleRate,
+                                                    inLayout, decoder->sample_fmt, decoder->sample_rate,
+                                                    0, NULL);
+        if (resampler == nullptr || swr_init (resampler) < 0) {
+            DBG ("Could not convert the audio for the writer");
+            swr_free (&resampler);
+            avcodec_free_context (&decoder);
+            return false;
+        }
+
+        // the audio starts where the first video segment starts
+        const double startSeconds = input->start_time != AV_NOPTS_VALUE ? static_cast<double> (input->start_time) / AV_TIME_BASE : 0.0;
+        juce::int64 samplesWritten = 0;
+        AudioBuffer<float> buffer;
+        AVFrame* frame = av_frame_alloc();
+
+        auto writeConverted = [&] (const int numConverted, const int skip)
+        {
+            if (numConverted - skip <= 0)
+                return;
+            AudioBuffer<float> part (buffer.getArrayOfWritePointers(), 2, skip, numConverted - skip);
+            AudioSourceChannelInfo info (&part, 0, part.getNumSamples());
+            writer.writeNextAudioBlock (info);
+            samplesWritten += part.getNumSamples();
+            secondsDone = static_cast<double> (samplesWritten) / sampleRate;
+        };
+
+        auto receiveFrames = [&]
+        {
+            while (avcodec_receive_frame (decoder, frame) >= 0) {
+                const int64_t pts = av_frame_get_best_effort_timestamp (frame);
+                const int maxSamples = swr_get_out_samples (resampler, frame->nb_samples);
+                buffer.setSize (2, jmax (1, maxSamples), false, false, true);
+                const int numConverted = swr_convert (resampler,
+                                                      reinterpret_cast<uint8_t**> (buffer.getArrayOfWritePointers()), maxSamples,
+                                                      const_cast<const uint8_t**> (frame->extended_data), frame->nb_samples);
+
+                int skip = 0;
+                if (samplesWritten == 0 && pts != AV_NOPTS_VALUE) {
+                    const int position = roundToInt ((av_q2d (stream->time_base) * pts - startSeconds) * sampleRate);
+                    if (position > 0) {
+                        // the audio starts later than the video, fill the gap with silence
+                        AudioBuffer<float> silence (2, position);
+                        silence.clear();
+                        AudioSourceChannelInfo info (&silence, 0, position);
+                        writer.writeNextAudioBlock (info);
+                        samplesWritten = position;
+                    }
+                    skip = jmax (0, -position);
+                }
+                writeConverted (numConverted, jmin (skip, jmax (0, numConverted)));
+                av_frame_unref (frame);
+            }
+        };
+
+        AVPacket packet;
+        packet.data = NULL;
+        packet.size = 0;
+        av_init_packet (&packet);
+        while (! shouldStop() && av_read_frame (input, &packet) >= 0) {
+            if (packet.stream_index == streamIdx && avcodec_send_packet (decoder, &packet) >= 0)
+                receiveFrames();
+            av_packet_unref (&packet);
+        }
+
+        avcodec_send_packet (decoder, NULL);
+        receiveFrames();
+
+        // the resampler holds back a few samples
+        const int remaining = swr_get_out_samples (resampler, 0);
+        if (remaining > 0) {
+            buffer.setSize (2, remaining, false, false, true);
+            writeConverted (swr_convert (resampler, reinterpret_cast<uint8_t**> (buffer.getArrayOfWritePointers()), remaining, NULL, 0), 0);
+        }
+
+        av_frame_free (&frame);
+        swr_free (&resampler);
+        avcodec_free_context (&decoder);
+        return ! shouldStop();
+    }
+
+    FFmpegTranscoder&       owner;
+    FFmpegVideoWriter       writer;
+    const juce::File        outputFile;
+    const AVMediaType       type;
+    const int64_t           startTs;
+    const int64_t           endTs;
+    const int               numThreads;
+    std::atomic<double>     secondsDone;
+    std::atomic<bool>       succeeded;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SegmentJob)
+};
+
+FFmpegTranscoder::FFmpegTranscoder ()
+  : juce::Thread        ("FFmpeg transcoder"),
+    job                 (noJob),
+    running             (false),
+    cancelled           (false),
+    reader              (nullptr),
+    writer              (nullptr),
+    audioSource         (nullptr),
+    writerSettings      (nullptr),
+    blockSize           (1024),
+    numSegments         (0),
+    startTime           (0.0),
+    lastReportTime      (0.0),
+    endTime             (0.0),
+    progress            (0.0),
+    mediaSecondsDone    (0.0),
+    numFramesDone       (0)
+{
+}
+
+FFmpegTranscoder::~FFmpegTranscoder ()
+{
+    cancel ();
+    stopThread (-1);
+}
+
+bool FFmpegTranscoder::transcode (FFmpegVideoReader& readerToUse, FFmpegVideoWriter& writerToUse, const bool runInBackground)
+{
+    {
+        ScopedLock lock (jobLock);
+        if (! claimJob())
+            return false;
+
+        job    = transcodeJob;
+        reader = &readerToUse;
+        writer = &writerToUse;
+    }
+    return startJob (runInBackground);
+}
+
+bool FFmpegTranscoder::remux (const juce::File& input, const juce::File& output, const juce::String& format, const bool runInBackground)
+{
+    {
+        ScopedLock lock (jobLock);
+        if (! claimJob())
+            return false;
+
+        job          = remuxJob;
+        inputFile    = input;
+        outputFile   = output;
+        outputFormat = format;
+    }
+    return startJob (runInBackground);
+}
+
+bool FFmpegTranscoder::replaceAudio (const juce::File& videoFile, juce::AudioSource& source,
+                                     FFmpegVideoWriter& writerToUse, const juce::File& output,
+                                     const juce::String& format, const bool runInBackground)
+{
+    {
+        ScopedLock lock (jobLock);
+        if (! claimJob())
+            return false;
+
+        job          = replaceAudioJob;
+        inputFile    = videoFile;
+        audioSource  = &source;
+        writer       = &writerToUse;
+        outputFile   = output;
+        outputFormat = format;
+    }
+    return startJob (runInBackground);
+}
+
+bool FFmpegTranscoder::concatenate (const juce::Array<juce::File>& inputs, const juce::File& output,
+                                    const juce::String& format, const bool runInBackground)
+{
+    {
+        ScopedLock lock (jobLock);
+        if (! claimJob())
+            return false;
+
+        job          = concatenateJob;
+        inputFiles   = inputs;
+        outputFile   = output;
+        outputFormat = format;
+    }
+    return startJob (runInBackground);
+}
+
+bool FFmpegTranscoder::transcodeInSegments (const juce::File& input, const FFmpegVideoWriter& settings,
+                                            const juce::File& output, const int numParts,
+                                            const juce::String& format, const bool runInBackground)
+{
+    {
+        ScopedLock lock (jobLock);
+        if (! claimJob())
+            return false;
+
+        job            = segmentedJob;
+        inputFile      = input;
+        writerSettings = &settings;
+        outputFile     = output;
+        numSegments    = numParts > 0 ? numParts : SystemStats::getNumCpuCores();
+        outputFormat   = format;
+    }
+    return startJob (runInBackground);
+}
+
+bool FFmpegTranscoder::claimJob ()
+{
+    // called with jobLock held, so only one caller sets up a job
+    if (running)
+        return false;
+
+    // a finished background job might not have left run() yet
+    stopThread (-1);
+    running = true;
+    return true;
+}
+
+bool FFmpegTranscoder::startJob (const bool runInBackground)
+{
+    cancelled        = false;
+    progress         = 0.0;
+    mediaSecondsDone = 0.0;
+    numFramesDone    = 0;
+    startTime        = Time::getMillisecondCounterHiRes();
+    lastReportTime   = startTime;
+    endTime          = 0.0;
+
+    if (runInBackground) {
+        startThread ();
+        return true;
+    }
+    return runJob ();
+}
+
+void FFmpegTranscoder::run ()
+{
+    runJob ();
+}
+
+bool FFmpegTranscoder::runJob ()
+{
+    bool success = false;
+    if (job == transcodeJob)
+        success = runTranscode ();
+    else if (job == remuxJob)
+        success = runRemux ();
+    else if (job == replaceAudioJob)
+        success = runReplaceAudio ();
+    else if (job == concatenateJob)
+        success = runConcatenate ();
+    else if (job == segmentedJob)
+        success = runSegmented ();
+
+    success = success && ! cancelled;
+    if (success)
+        progress = 1.0;
+
+    endTime = Time::getMillisecondCounterHiRes();
+    {
+        ScopedLock lock (jobLock);
+        job     = noJob;
+        reader  = nullptr;
+        writer  = nullptr;
+        audioSource = nullptr;
+        writerSettings = nullptr;
+        inputFiles.clear();
+        running = false;
+    }
+    listeners.call (&Listener::transcodingFinished, *this, success);
+    return success;
+}
+
+bool FFmpegTranscoder::runTranscode ()
+{
+    if (reader->getVideoSamplingRate() <= 0) {
+        // the audio is the clock of the reader, without it no frame would ever be shown
+        DBG ("Transcoding needs a reader with an audio stream");
+        writer->closeMovieFile ();
+        return false;
+    }
+
+    const bool wasNonRealtime = reader->isNonRealtime();
+    reader->setNonRealtime (true);
+    reader->addVideoListener (writer);
+    reader->addVideoListener (this);
+
+    const double duration = reader->getVideoDuration();
+
+    // the writer's FIFO takes two channels
+    AudioBuffer<float> buffer (2, blockSize);
+    while (! reader->isEndOfStream() && ! shouldStop()) {
+        AudioSourceChannelInfo info (&buffer, 0, blockSize);
+        const int numRead = reader->readNextAudioBlock (info);
+        if (reader->isEndOfStream()) {
+            // don't pad the end of the audio with silence
+            info.numSamples = numRead;
+        }
+        if (info.numSamples > 0) {
+            writer->writeNextAudioBlock (info);
+        }
+
+        reportProgress (reader->getCurrentTimeStamp(), duration);
+    }
+
+    // the last frames might still be on their way to the writer
+    reader->waitUntilFramesShown ();
+    writer->closeMovieFile ();
+
+    reader->removeVideoListener (this);
+    reader->removeVideoListener (writer);
+    reader->setNonRealtime (wasNonRealtime);
+    return writer->getNumWrittenPackets() > 0;
+}
+
+AVFormatContext* FFmpegTranscoder::openInput (const juce::File& file)
+{
+    AVFormatContext* input = nullptr;
+    if (avformat_open_input (&input, file.getFullPathName().toRawUTF8(), NULL, NULL) < 0) {
+        DBG ("Could not open " + file.getFullPathName());
+        return nullptr;
+    }
+    if (avformat_find_stream_info (input, NULL) < 0) {
+        DBG ("Could not find the streams of " + file.getFullPathName());
+        avformat_close_input (&input);
+        return nullptr;
+    }
+    return input;
+}
+
+int FFmpegTranscoder::findVideoStream (AVFormatContext* input)
+{
+    const int videoIdx = av_find_best_stream (input, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (videoIdx >= 0 && (input->streams [videoIdx]->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+        // a cover image is not a video stream
+        return -1;
+    }
+    return videoIdx;
+}
+
+bool FFmpegTranscoder::runRemux ()
+{
+    AVFormatContext* input = openInput (inputFile);
+    if (input == nullptr)
+        return false;
+
+    const int videoIdx = findVideoStream (input);
+    const int audioIdx = av_find_best_stream (input, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+
+    FFmpegVideoWriter output;
+    if (videoIdx >= 0)
+        output.setStreamCopy (input->streams [videoIdx]);
+    if (audioIdx >= 0)
+        output.setStreamCopy (input->streams [audioIdx]);
+
+    if ((videoIdx < 0 && audioIdx < 0) || ! output.openMovieFile (outputFile, outputFormat)) {
+        DBG ("Could not open " + outputFile.getFullPathName() + " for remuxing");
+        avformat_close_input (&input);
+        return false;
+    }
+
+    const double duration = input->duration != AV_NOPTS_VALUE ? static_cast<double> (input->duration) / AV_TIME_BASE : 0.0;
+    const double startSeconds = input->start_time != AV_NOPTS_VALUE ? static_cast<double> (input->start_time) / AV_TIME_BASE : 0.0;
+
+    bool success = true;
+    AVPacket packet;
+    packet.data = NULL;
+    packet.size = 0;
+    av_init_packet (&packet);
+    while (! shouldStop() && av_read_frame (input, &packet) >= 0) {
+        if (packet.stream_index == videoIdx || packet.stream_index == audioIdx) {
+            const AVStream* stream = input->streams [packet.stream_index];
+            const AVMediaType type = stream->codecpar->codec_type;
+            if (! output.writePacket (&packet, type)) {
+                success = false;
+                av_packet_unref (&packet);
+                break;
+            }
+            if (type == AVMEDIA_TYPE_VIDEO)
+                ++numFramesDone;
+
+            const int64_t timestamp = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+            if (timestamp != AV_NOPTS_VALUE)
+                reportProgress (av_q2d (stream->time_base) * timestamp - startSeconds, duration);
+        }
+        av_packet_unref (&packet);
+    }
+
+    output.closeMovieFile ();
+    avformat_close_input (&input);
+    return success;
+}
+
+void FFmpegTranscoder::reportProgress (const double mediaSeconds, const double duration)
+{
+    if (mediaSeconds > mediaSecondsDone)
+        mediaSecondsDone = mediaSeconds;
+
+    if (duration > 0.0)
+        progress = jlimit (0.0, 1.0, mediaSecondsDone / duration);
+
+    const double now = Time::getMillisecondCounterHiRes();
+    if (now - lastReportTime >= progressInterval) {
+        lastReportTime = now;
+        listeners.call (&Listener::transcodingProgress, *this, progress.load());
+    }
+}
+
+void FFmpegTranscoder::displayNewFrame (const AVFrame*)
+{
+    ++numFramesDone;
+}
+
+bool FFmpegTranscoder::shouldStop () const
+{
+    return cancelled;
+}
+
+void FFmpegTranscoder::cancel ()
+{
+    cancelled = true;
+    signalThreadShouldExit ();
+}
+
+bool FFmpegTranscoder::isTranscoding () const
+{
+    return running;
+}
+
+bool FFmpegTranscoder::wasCancelled () const
+{
+    return cancelled;
+}
+
+double FFmpegTranscoder::getProgress () const
+{
+    return progress;
+}
+
+double FFmpegTranscoder::getSpeed () const
+{
+    const double elapsed = getElapsedTime();
+    return elapsed > 0.0 ? mediaSecondsDone / elapsed : 0.0;
+}
+
+double FFmpegTranscoder::getFramesPerSecond () const
+{
+    const double elapsed = getElapsedTime();
+    return elapsed > 0.0 ? numFramesDone / elapsed : 0.0;
+}
+
+double FFmpegTranscoder::getElapsedTime () const
+{
+    if (startTime <= 0.0)
+        return 0.0;
+
+    const double end = running ? Time::getMillisecondCounterHiRes() : endTime.load();
+    return (end - startTime) / 1000.0;
+}
+
+void FFmpegTranscoder::setBlockSize (const int numSamples)
+{
+    blockSize = jmax (64, numSamples);
+}
+
+void FFmpegTranscoder::addListener (Listener* listener)
+{
+    listeners.add (listener);
+}
+
+void FFmpegTranscoder::removeListener (Listener* listener)
+{
+    listeners.remove (listener);
+}
+
+bool FFmpegTranscoder::runReplaceAudio ()
+{
+    AVFormatContext* input = openInput (inputFile);
+    if (input == nullptr)
+        return false;
+
+    const int videoIdx = findVideoStream (input);
+    if (videoIdx < 0) {
+        DBG ("No video stream found in " + inputFile.getFullPathName());
+        avformat_close_input (&input);
+        return false;
+    }
+
+    const AVStream* videoStream = input->streams [videoIdx];
+    writer->setStreamCopy (videoStream);
+    if (! writer->openMovieFile (outputFile, outputFormat)) {
+        DBG ("Could not open " + outputFile.getFullPathName() + " for writing");
+        writer->clearStreamCopies ();
+        avformat_close_input (&input);
+        return false;
+    }
+
+    // the new audio starts at zero, so the video has to start there as well
+    const double  startSeconds = input->start_time != AV_NOPTS_VALUE ? static_cast<double> (input->start_time) / AV_TIME_BASE : 0.0;
+    const int64_t offset = -av_rescale_q (input->start_time != AV_NOPTS_VALUE ? input->start_time : 0,
+                                          av_make_q (1, AV_TIME_BASE), videoStream->time_base);
+    // the container duration includes the old audio, which can be longer than the video
+    const double  duration = videoStream->duration != AV_NOPTS_VALUE ? av_q2d (videoStream->time_base) * videoStream->duration :
+                             input->duration != AV_NOPTS_VALUE ? static_cast<double> (input->duration) / AV_TIME_BASE : 0.0;
+    // the end of the last picture, the audio is cut there
+    double videoEnd = 0.0;
+
+    const double sampleRate = writer->getSampleRate();
+    juce::int64 samplesWritten = 0;
+
+    audioSource->prepareToPlay (blockSize, sampleRate);
+    AudioBuffer<float> buffer (2, blockSize);
+
+    // pulls audio up to seconds, so audio and video arrive at the muxer interleaved
+    auto writeAudioUntil = [&] (const double seconds)
+    {
+        const juce::int64 end = static_cast<juce::int64> (seconds * sampleRate);
+        while (samplesWritten < end && ! shouldStop()) {
+            const int numSamples = static_cast<int> (jmin (static_cast<juce::int64> (blockSize), end - samplesWritten));
+            AudioSourceChannelInfo info (&buffer, 0, numSamples);
+            audioSource->getNextAudioBlock (info);
+            writer->writeNextAudioBlock (info);
+            samplesWritten += numSamples;
+        }
+    };
+
+    bool success = true;
+    AVPacket packet;
+    packet.data = NULL;
+    packet.size = 0;
+    av_init_packet (&packet);
+    while (! shouldStop() && av_read_frame (input, &packet) >= 0) {
+        if (packet.stream_index == videoIdx) {
+            const int64_t timestamp = packet.dts != AV_NOPTS_VALUE ? packet.dts : packet.pts;
+            if (timestamp != AV_NOPTS_VALUE) {
+                const double seconds = av_q2d (videoStream->time_base) * timestamp - startSeconds;
+                writeAudioUntil (seconds);
+                reportProgress (seconds, duration);
+            }
+            if (packet.pts != AV_NOPTS_VALUE) {
+                videoEnd = jmax (videoEnd, av_q2d (videoStream->time_base) * (packet.pts + packet.duration) - startSeconds);
+            }
+            if (! writer->writePacket (&packet, AVMEDIA_TYPE_VIDEO, offset)) {
+                success = false;
+                av_packet_unref (&packet);
+                break;
+            }
+            ++numFramesDone;
+        }
+        av_packet_unref (&packet);
+    }
+
+    if (success)
+        writeAudioUntil (videoEnd > 0.0 ? videoEnd : duration);
+
+    audioSource->releaseResources ();
+    writer->closeMovieFile ();
+    writer->clearStreamCopies ();
+    avformat_close_input (&input);
+    return success;
+}
+
+juce::String FFmpegTranscoder::compareStreams (const AVStream* first, const AVStream* other)
+{
+    const AVCodecParameters* a = first->codecpar;
+    const AVCodecParameters* b = other->codecpar;
+
+    if (a->codec_type != b->codec_type || a->codec_id != b->codec_id)
+        return "codec " + String (avcodec_get_name (b->codec_id)) + " instead of " + String (avcodec_get_name (a->codec_id));
+
+    if (a->codec_type == AVMEDIA_TYPE_VIDEO) {
+        if (a->width != b->width || a->height != b->height)
+            return "size " + String (b->width) + "x" + String (b->height) + " instead of " + String (a->width) + "x" + String (a->height);
+        if (a->format != b->format)
+            return "different pixel format";
+        if (a->profile != b->profile)
+            return "different profile";
+    }
+    else if (a->codec_type == AVMEDIA_TYPE_AUDIO) {
+        if (a->sample_rate != b->sample_rate)
+            return "sample rate " + String (b->sample_rate) + " instead of " + String (a->sample_rate);
+        if (a->channels != b->channels)
+            return String (b->channels) + " channels instead of " + String (a->channels);
+        if (a->format != b->format)
+            return "different sample format";
+    }
+
+    // the header of the output is written from the first file, so the decoder
+    // configuration must be the same for all files
+    if (a->extradata_size != b->extradata_size ||
+        (a->extradata_size > 0 && memcmp (a->extradata, b->extradata, static_cast<size_t> (a->extradata_size)) != 0))
+        return "different codec configuration (extradata)";
+
+    return String();
+}
+
+juce::Result FFmpegTranscoder::checkConcatenation (const juce::Array<juce::File>& inputs)
+{
+    if (inputs.isEmpty())
+        return Result::fail ("No files to concatenate");
+
+    AVFormatContext* first = openInput (inputs.getReference (0));
+    if (first == nullptr)
+        return Result::fail ("Could not open " + inputs.getReference (0).getFullPathName());
+
+    const int firstVideo = findVideoStream (first);
+    const int firstAudio = av_find_best_stream (first, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (firstVideo < 0 && firstAudio < 0) {
+        avformat_close_input (&first);
+        return Result::fail ("No audio or video in " + inputs.getReference (0).getFullPathName());
+    }
+
+    Result result = Result::ok();
+    for (int i=1; i < inputs.size() && result.wasOk(); ++i) {
+        const File& file = inputs.getReference (i);
+        AVFormatContext* input = openInput (file);
+        if (input == nullptr) {
+            result = Result::fail ("Could not open " + file.getFullPathName());
+            break;
+        }
+
+        const int videoIdx = findVideoStream (input);
+        const int audioIdx = av_find_best_stream (input, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+        String mismatch;
+        if ((firstVideo >= 0) != (videoIdx >= 0))
+            mismatch = videoIdx >= 0 ? "an additional video stream" : "no video stream";
+        else if ((firstAudio >= 0) != (audioIdx >= 0))
+            mismatch = audioIdx >= 0 ? "an additional audio stream" : "no audio stream";
+        else if (videoIdx >= 0)
+            mismatch = compareStreams (first->streams [firstVideo], input->streams [videoIdx]);
+
+        if (mismatch.isEmpty() && audioIdx >= 0)
+            mismatch = compareStreams (first->streams [firstAudio], input->streams [audioIdx]);
+
+        if (mismatch.isNotEmpty())
+            result = Result::fail (file.getFullPathName() + " has " + mismatch);
+
+        avformat_close_input (&input);
+    }
+
+    avformat_close_input (&first);
+    return result;
+}
+
+bool FFmpegTranscoder::runConcatenate ()
+{
+    const Result compatible = checkConcatenation (inputFiles);
+    if (compatible.failed()) {
+        DBG ("Cannot concatenate: " + compatible.getErrorMessage());
+        return false;
+    }
+
+    // the duration is only known for the files already opened, the progress
+    // assumes the others are equally long
+    double knownDuration = 0.0;
+
+    FFmpegVideoWriter output;
+    ConcatContext concat;
+    concat.output        = &output;
+    concat.videoTimeBase = av_make_q (1, AV_TIME_BASE);
+    concat.audioTimeBase = av_make_q (1, AV_TIME_BASE);
+    concat.position      = 0;
+    concat.duration      = 0.0;
+
+    bool success = true;
+    for (int i=0; i < inputFiles.size() && success && ! shouldStop(); ++i) {
+        AVFormatContext* input = openInput (inputFiles.getReference (i));
+        if (input == nullptr) {
+            success = false;
+            break;
+        }
+
+        const int videoIdx = findVideoStream (input);
+        const int audioIdx = av_find_best_stream (input, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+
+        if (i == 0) {
+            // the output streams are set up from the first file
+            if (videoIdx >= 0) {
+                output.setStreamCopy (input->streams [videoIdx]);
+                concat.videoTimeBase = input->streams [videoIdx]->time_base;
+            }
+            if (audioIdx >= 0) {
+                output.setStreamCopy (input->streams [audioIdx]);
+                concat.audioTimeBase = input->streams [audioIdx]->time_base;
+            }
+            if (! output.openMovieFile (outputFile, outputFormat)) {
+                DBG ("Could not open " + outputFile.getFullPathName() + " for concatenating");
+                avformat_close_input (&input);
+                success = false;
+                break;
+            }
+        }
+
+        knownDuration += input->duration != AV_NOPTS_VALUE ? static_cast<double> (input->duration) / AV_TIME_BASE : 0.0;
+        concat.duration = knownDuration * inputFiles.size() / (i + 1);
+
+        success = appendFile (concat, input, videoIdx, audioIdx);
+        avformat_close_input (&input);
+    }
+
+    output.closeMovieFile ();
+    return success;
+}
+
+bool FFmpegTranscoder::appendFile (ConcatContext& concat, AVFormatContext* input, const int videoIdx, const int audioIdx,
+                                   std::function<bool (double)> beforeVideoPacket)
+{
+    const AVRational microseconds = av_make_q (1, AV_TIME_BASE);
+
+    const int64_t start  = input->start_time != AV_NOPTS_VALUE ? input->start_time : 0;
+    const int64_t offset = concat.position - start;
+    int64_t end = concat.position;
+
+    bool success = true;
+    AVPacket packet;
+    packet.data = NULL;
+    packet.size = 0;
+    av_init_packet (&packet);
+    while (! shouldStop() && av_read_frame (input, &packet) >= 0) {
+        if (packet.stream_index == videoIdx || packet.stream_index == audioIdx) {
+            const AVStream*   stream   = input->streams [packet.stream_index];
+            const AVMediaType type     = stream->codecpar->codec_type;
+            const AVRational  timeBase = type == AVMEDIA_TYPE_VIDEO ? concat.videoTimeBase : concat.audioTimeBase;
+
+            // the time bases of the files can differ, the writer expects the one of the first file
+            if (packet.duration <= 0 && type == AVMEDIA_TYPE_VIDEO && stream->avg_frame_rate.num > 0)
+                packet.duration = av_rescale_q (1, av_inv_q (stream->avg_frame_rate), stream->time_base);
+            av_packet_rescale_ts (&packet, stream->time_base, timeBase);
+
+            const int64_t timestamp = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+            const int64_t packetEnd = timestamp != AV_NOPTS_VALUE ? av_rescale_q (timestamp + jmax (int64_t (0), packet.duration), timeBase, microseconds) + offset
+                                                                  : end;
+
+            if (type == AVMEDIA_TYPE_VIDEO && beforeVideoPacket && packet.dts != AV_NOPTS_VALUE &&
+                ! beforeVideoPacket (static_cast<double> (av_rescale_q (packet.dts, timeBase, microseconds) + offset) / AV_TIME_BASE)) {
+                success = false;
+                av_packet_unref (&packet);
+                break;
+            }
+
+            if (! concat.output->writePacket (&packet, type, av_rescale_q (offset, microseconds, timeBase))) {
+                success = false;
+                av_packet_unref (&packet);
+                break;
+            }
+            if (type == AVMEDIA_TYPE_VIDEO)
+                ++numFramesDone;
+
+            end = jmax (end, packetEnd);
+            reportProgress (static_cast<double> (packetEnd) / AV_TIME_BASE, concat.duration);
+        }
+        av_packet_unref (&packet);
+    }
+
+    // the next file continues after the longest stream of this one
+    concat.position = end;
+    return success;
+}
+
+bool FFmpegTranscoder::runSegmented ()
+{
+    AVFormatContext* input = openInput (inputFile);
+    if (input == nullptr)
+        return false;
+
+    const int videoIdx = findVideoStream (input);
+    const int audioIdx = av_find_best_stream (input, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    const bool withAudio = audioIdx >= 0 && writerSettings->getAudioCodec() > AV_CODEC_ID_NONE;
+    const AVRational timeBase = videoIdx >= 0 ? input->streams [videoIdx]->time_base : av_make_q (1, AV_TIME_BASE);
+    const int64_t start = av_rescale_q (input->start_time != AV_NOPTS_VALUE ? input->start_time : 0,
+                                        av_make_q (1, AV_TIME_BASE), timeBase);
+    const double startSeconds = av_q2d (timeBase) * start;
+    const double duration = input->duration != AV_NOPTS_VALUE ? static_cast<double> (input->duration) / AV_TIME_BASE : 0.0;
+    avformat_close_input (&input);
+
+    if (videoIdx < 0) {
+        DBG ("Segmented transcoding needs a video stream in " + inputFile.getFullPathName());
+        return false;
+    }
+
+    // the segments can only start at keyframes
+    std::vector<int64_t> boundaries (1, start);
+    {
+        FFmpegSeekIndex index;
+        index.buildIndex (inputFile, videoIdx);
+        while (! index.waitForThreadToExit (static_cast<int> (progressInterval)))
+            if (shouldStop())
+                return false;
+
+        for (int i=1; i < numSegments; ++i) {
+            FFmpegSeekIndex::Entry keyframe;
+            if (index.findKeyframe (startSeconds + duration * i / numSegments, keyframe) && keyframe.pts > boundaries.back())
+                boundaries.push_back (keyframe.pts);
+        }
+    }
+    boundaries.push_back (std::numeric_limits<int64_t>::max());
+
+    const int numParts = static_cast<int> (boundaries.size()) - 1;
+    const int threadsPerJob = jmax (1, SystemStats::getNumCpuCores() / (numParts + (withAudio ? 1 : 0)));
+
+    OwnedArray<TemporaryFile> partFiles;
+    OwnedArray<SegmentJob>    jobs;
+    for (int i=0; i < numParts; ++i) {
+        TemporaryFile* part = partFiles.add (new TemporaryFile (outputFile, TemporaryFile::useHiddenFile));
+        jobs.add (new SegmentJob (*this, *writerSettings, part->getFile(), AVMEDIA_TYPE_VIDEO,
+                                  boundaries [i], boundaries [i + 1], threadsPerJob));
+    }
+
+    ScopedPointer<TemporaryFile> audioFile;
+    if (withAudio) {
+        audioFile = new TemporaryFile (outputFile, TemporaryFile::useHiddenFile);
+        jobs.add (new SegmentJob (*this, *writerSettings, audioFile->getFile(), AVMEDIA_TYPE_AUDIO, 0, 0, 1));
+    }
+
+    {
+        ThreadPool pool (jobs.size());
+        for (auto* job : jobs)
+            pool.addJob (job, false);
+
+        while (pool.getNumJobs() > 0) {
+            Thread::sleep (static_cast<int> (progressInterval));
+            double seconds = 0.0;
+            for (int i=0; i < numParts; ++i)
+                seconds += jobs.getUnchecked (i)->getSecondsDone();
+            reportProgress (seconds, duration);
+        }
+    }
+
+    for (auto* job : jobs) {
+        if (! job->hasSucceeded())
+            return false;
+    }
+
+    Array<File> parts;
+    for (auto* part : partFiles)
+        parts.add (part->getFile());
+
+    const Result compatible = checkConcatenation (parts);
+    if (compatible.failed()) {
+        DBG ("The encoded segments don't match: " + compatible.getErrorMessage());
+        return false;
+    }
+
+    // join the video parts and interleave the audio from its own file
+    AVFormatContext* audioInput = nullptr;
+    if (withAudio && (audioInput = openInput (audioFile->getFile())) == nullptr)
+        return false;
+
+    FFmpegVideoWriter output;
+    ConcatContext concat;
+    concat.output        = &output;
+    concat.videoTimeBase = av_make_q (1, AV_TIME_BASE);
+    concat.audioTimeBase = audioInput != nullptr ? audioInput->streams [0]->time_base : av_make_q (1, AV_TIME_BASE);
+    concat.position      = 0;
+    concat.duration      = duration;
+
+    AVPacket audioPacket;
+    audioPacket.data = NULL;
+    audioPacket.size = 0;
+    av_init_packet (&audioPacket);
+    bool audioPending = false;
+
+    // returns false, if the muxer rejected a packet
+    auto writeAudioUntil = [&] (const double seconds)
+    {
+        while (audioInput != nullptr) {
+            if (! audioPending) {
+                if (av_read_frame (audioInput, &audioPacket) < 0)
+                    return true;
+                audioPending = true;
+            }
+            const int64_t timestamp = audioPacket.dts != AV_NOPTS_VALUE ? audioPacket.dts : audioPacket.pts;
+            if (timestamp != AV_NOPTS_VALUE && av_q2d (concat.audioTimeBase) * timestamp > seconds)
+                return true;
+
+            const bool written = output.writePacket (&audioPacket, AVMEDIA_TYPE_AUDIO);
+            av_packet_unref (&audioPacket);
+            audioPending = false;
+            if (! written) {
+                DBG ("Writing the audio of the segmented transcode failed");
+                return false;
+            }
+        }
+        return true;
+    };
+
+    bool success = true;
+    for (int i=0; i < parts.size() && success && ! shouldStop(); ++i) {
+        AVFormatContext* part = openInput (parts.getReference (i));
+        if (part == nullptr) {
+            success = false;
+            break;
+        }
+        if (i == 0) {
+            output.setStreamCopy (part->streams [0]);
+            concat.videoTimeBase = part->streams [0]->time_base;
+            if (audioInput != nullptr)
+                output.setStreamCopy (audioInput->streams [0]);
+
+            if (! output.openMovieFile (outputFile, outputFormat)) {
+                DBG ("Could not open " + outputFile.getFullPathName() + " for writing");
+                avformat_close_input (&part);
+                success = false;
+                break;
+            }
+        }
+        success = appendFile (concat, part, 0, -1, writeAudioUntil);
+        avformat_close_input (&part);
+    }
+
+    if (success)
+        success = writeAudioUntil (std::numeric_limits<double>::max());
+
+    av_packet_unref (&audioPacket);
+    if (audioInput != nullptr)
+        avformat_close_input (&audioInput);
+
+    output.closeMovieFile ();
+    return success;
+}
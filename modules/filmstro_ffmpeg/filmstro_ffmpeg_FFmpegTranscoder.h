@@ -0,0 +1,268 @@
+/*
+ ==============================================================================
+ Copyright (c) 2026, Filmstro Ltd.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+ 3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+ ==============================================================================
+
+ \class        FFmpegTranscoder
+ \file         filmstro_ffmpeg_FFmpegTranscoder.h
+ \brief        Connects a reader to a writer for offline processing
+
+ \author       Filmstro Ltd.
+ \date         October 16th 2026
+
+ \description  Runs exports as fast as decoding and encoding allow, without
+               being paced by the audio clock. Reports progress and throughput
+               and can be cancelled.
+
+ ==============================================================================
+ */
+
+
+#ifndef FILMSTRO_FFMPEG_FFMPEGTRANSCODER_H_INCLUDED
+#define FILMSTRO_FFMPEG_FFMPEGTRANSCODER_H_INCLUDED
+
+#include <atomic>
+#include <functional>
+
+/**
+ \class         FFmpegTranscoder
+ \description   Drives a FFmpegVideoReader and a FFmpegVideoWriter offline
+
+ transcode pulls the audio blocks from a reader in non realtime mode, so every
+ video frame reaches the writer and nothing is dropped. remux copies the packets
+ of a file into a new container without decoding them at all, which is only
+ limited by the disk. concatenate does the same for a list of files.
+ transcodeInSegments encodes parts of a file in parallel and joins them.
+
+ Both run either blocking on the calling thread or on the transcoder's own thread.
+ Only one job can run at a time.
+ */
+class FFmpegTranscoder : private juce::Thread,
+                         private FFmpegVideoListener
+{
+public:
+    /**
+     \class         FFmpegTranscoder::Listener
+     \description   Receives progress and the result of a job
+     */
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        /** Called every now and then with the progress between 0.0 and 1.0. This is
+         called from the thread the job runs on. */
+        virtual void transcodingProgress (FFmpegTranscoder& transcoder, const double progress) {}
+
+        /** Called when a job ended. success is false, if it failed or was cancelled.
+         This is called from the thread the job runs on, so don't start the next
+         background job from here. */
+        virtual void transcodingFinished (FFmpegTranscoder& transcoder, const bool success) = 0;
+    };
+
+    FFmpegTranscoder ();
+
+    /** Cancels a running job and waits for it to end */
+    ~FFmpegTranscoder ();
+
+    /** Reads all audio and video from reader and encodes it with writer. The reader
+     has to be loaded and prepared with prepareToPlay, the writer has to be opened.
+     The audio stream of the reader is its clock, so files without audio fail. The
+     job fails as well, if the writer didn't write anything.
+     The writer is closed, when the job ends. If runInBackground is false, this
+     blocks until the job ended and returns the result. Otherwise it returns, if
+     the job was started. */
+    bool transcode (FFmpegVideoReader& reader, FFmpegVideoWriter& writer, const bool runInBackground = false);
+
+    /** Copies the packets of the best audio and video stream of input into output
+     without decoding and encoding. If format is empty, it is guessed from the
+     output file name. */
+    bool remux (const juce::File& input, const juce::File& output,
+                const juce::String& format = juce::String(), const bool runInBackground = false);
+
+    /** Copies the video packets of the best video stream of videoFile and encodes
+     the audio pulled from audioSource as the only audio track. The picture is not
+     decoded, so this runs as fast as the audio encoder allows. The writer has to be
+     set up for the audio, e.g. with setAudioCodec and setSampleRate, but must not be
+     opened. The audioSource is prepared with the writer's sample rate, it should
+     deliver two channels. The audio is cut at the end of the video. */
+    bool replaceAudio (const juce::File& videoFile, juce::AudioSource& audioSource,
+                       FFmpegVideoWriter& writer, const juce::File& output,
+                       const juce::String& format = juce::String(), const bool runInBackground = false);
+
+    /** Joins the inputs into one output file by copying the packets of the best
+     audio and video stream of each file. The timestamps of each file continue
+     where the previous file ended. All inputs need the same streams with the same
+     codec parameters, checkConcatenation is called before anything is written. */
+    bool concatenate (const juce::Array<juce::File>& inputs, const juce::File& output,
+                      const juce::String& format = juce::String(), const bool runInBackground = false);
+
+    /** Checks, if the inputs can be joined by concatenate without re-encoding. The
+     result contains a description of the first mismatch. */
+    static juce::Result checkConcatenation (const juce::Array<juce::File>& inputs);
+
+    /** Transcodes input on several cores with the settings of writerSettings. The video
+     is split at keyframes into numSegments parts, each part is decoded and encoded by
+     its own worker with its own format contexts and encoder. The audio is encoded in
+     one piece by another worker, so there are no gaps where the parts meet. Finally
+     the parts are concatenated into output without encoding them again.
+
+     writerSettings only serves as template, it is not opened. A numSegments of 0 uses
+     one segment per core. The parts are written to temporary files next to output. */
+    bool transcodeInSegments (const juce::File& input, const FFmpegVideoWriter& writerSettings,
+                              const juce::File& output, const int numSegments = 0,
+                              const juce::String& format = juce::String(), const bool runInBackground = false);
+
+    /** Stops the running job. The output is closed, but it is incomplete. */
+    void cancel ();
+
+    /** Returns true, while a job is running */
+    bool isTranscoding () const;
+
+    /** Returns true, if the last job was cancelled */
+    bool wasCancelled () const;
+
+    /** Returns the progress of the current or last job between 0.0 and 1.0 */
+    double getProgress () const;
+
+    /** Returns the seconds of media processed per second, e.g. 8.0 is eight times faster than realtime */
+    double getSpeed () const;
+
+    /** Returns the number of video frames written per second */
+    double getFramesPerSecond () const;
+
+    /** Returns the seconds since the job started, or the time the last job took */
+    double getElapsedTime () const;
+
+    /** Set the number of samples pulled from the reader at once. It doesn't need to
+     match the frame size of the audio encoder, the writer splits the blocks. */
+    void setBlockSize (const int numSamples);
+
+    void addListener (Listener* listener);
+
+    void removeListener (Listener* listener);
+
+private:
+    enum JobType
+    {
+        noJob = 0,
+        transcodeJob,
+        remuxJob,
+        replaceAudioJob,
+        concatenateJob,
+        segmentedJob
+    };
+
+    /** encodes one part of a segmented transcode */
+    class SegmentJob;
+
+    /** The state of a concatenation. The output timestamps continue from file to file */
+    struct ConcatContext
+    {
+        FFmpegVideoWriter*  output;
+        AVRational          videoTimeBase;
+        AVRational          audioTimeBase;
+        /** the point in the output in AV_TIME_BASE, where the next file starts */
+        int64_t             position;
+        /** the expected duration of the output, for the progress */
+        double              duration;
+    };
+
+    /** Marks the transcoder as running, returns false if a job runs already.
+     Call it while holding jobLock, before the job is set up */
+    bool claimJob ();
+
+    bool startJob (const bool runInBackground);
+
+    void run () override;
+
+    bool runJob ();
+
+    bool runTranscode ();
+
+    bool runRemux ();
+
+    bool runReplaceAudio ();
+
+    bool runConcatenate ();
+
+    bool runSegmented ();
+
+    /** Copies the packets of the streams videoIdx and audioIdx of input into the output.
+     beforeVideoPacket is called with the output time in seconds before each video packet,
+     if it returns false, appendFile stops and fails. */
+    bool appendFile (ConcatContext& concat, AVFormatContext* input, const int videoIdx, const int audioIdx,
+                     std::function<bool (double)> beforeVideoPacket = nullptr);
+
+    /** Opens a file for reading packets, returns nullptr if it fails */
+    static AVFormatContext* openInput (const juce::File& file);
+
+    /** Returns the index of the best video stream, ignoring cover pictures, or -1 */
+    static int findVideoStream (AVFormatContext* input);
+
+    /** Returns an empty string, if packets of both streams can go into the same output stream */
+    static juce::String compareStreams (const AVStream* first, const AVStream* other);
+
+    /** updates the statistics and calls the listeners, if the last call was long enough ago */
+    void reportProgress (const double mediaSeconds, const double duration);
+
+    /** counts the frames, that are handed to the writer */
+    void displayNewFrame (const AVFrame*) override;
+
+    bool shouldStop () const;
+
+    // ==============================================================================
+
+    juce::CriticalSection       jobLock;
+    JobType                     job;
+    std::atomic<bool>           running;
+    std::atomic<bool>           cancelled;
+
+    FFmpegVideoReader*          reader;
+    FFmpegVideoWriter*          writer;
+    juce::AudioSource*          audioSource;
+    const FFmpegVideoWriter*    writerSettings;
+    juce::File                  inputFile;
+    juce::Array<juce::File>     inputFiles;
+    juce::File                  outputFile;
+    juce::String                outputFormat;
+
+    int                         blockSize;
+    int                         numSegments;
+
+    double                      startTime;
+    double                      lastReportTime;
+    std::atomic<double>         endTime;
+    std::atomic<double>         progress;
+    std::atomic<double>         mediaSecondsDone;
+    std::atomic<juce::int64>    numFramesDone;
+
+    juce::ListenerList<Listener> listeners;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegTranscoder)
+};
+
+#endif /* FILMSTRO_FFMPEG_FFMPEGTRANSCODER_H_INCLUDED */
@@ -52,15 +52,21 @@
 // ==============================================================================
 
 FFmpegVideoComponent::FFmpegVideoComponent ()
-  : currentFrame (nullptr),
-    dirty        (true)
+  : dirty        (true)
 {
+    nextFrame    = framePool->acquireFrame();
+    currentFrame = framePool->acquireFrame();
     setOpaque (true);
     startTimerHz (80);
 }
 
 FFmpegVideoComponent::~FFmpegVideoComponent ()
 {
+    if (videoSource)
+        videoSource->removeVideoListener (this);
+
+    framePool->releaseFrame (nextFrame);
+    framePool->releaseFrame (currentFrame);
 }
 
 void FFmpegVideoComponent::resized ()
@@ -98,7 +104,15 @@ void FFmpegVideoComponent::timerCallback ()
 void FFmpegVideoComponent::paint (juce::Graphics& g)
 {
     g.fillAll (Colours::black);
-    if (videoSource && currentFrame && frameBuffer.isValid()) {
+    {
+        // only swap the references under the lock, so the audio thread is never blocked by painting
+        const ScopedLock lock (frameLock);
+        if (nextFrame->buf [0] != nullptr) {
+            av_frame_unref (currentFrame);
+            av_frame_move_ref (currentFrame, nextFrame);
+        }
+    }
+    if (videoSource && currentFrame->data [0] != nullptr && frameBuffer.isValid()) {
         videoScaler.convertFrameToImage (frameBuffer, currentFrame);
         g.drawImageAt (frameBuffer,
                        (getWidth() - frameBuffer.getWidth()) * 0.5,
@@ -112,10 +126,13 @@ void FFmpegVideoComponent::paint (juce::Graphics& g)
 /** callback from FFmpegVideoReader to display a new frame */
 void FFmpegVideoComponent::displayNewFrame (const AVFrame* frame)
 {
-    if (dirty) {
-        DBG ("Frame not painted: " + String (av_frame_get_best_effort_timestamp (currentFrame)));
+    const ScopedLock lock (frameLock);
+    if (dirty && nextFrame->buf [0] != nullptr) {
+        DBG ("Frame not painted: " + String (av_frame_get_best_effort_timestamp (nextFrame)));
     }
-    currentFrame = frame;
+    // keep a reference, so the decoder can't recycle the picture before it was painted
+    av_frame_unref (nextFrame);
+    av_frame_ref (nextFrame, frame);
     dirty = true;
 }
 
@@ -84,7 +84,15 @@ private:
     /** Reference to the FFmpegVideoReader to provide video frames */
     juce::WeakReference<FFmpegVideoReader>  videoSource;
 
-    const AVFrame*                          currentFrame;
+    /** Frame received from the reader, referenced until it is painted */
+    AVFrame*                                nextFrame;
+
+    /** Frame currently painted, the reader can't overwrite it */
+    AVFrame*                                currentFrame;
+
+    juce::CriticalSection                   frameLock;
+
+    juce::SharedResourcePointer<FFmpegFramePool> framePool;
 
     juce::Image                             frameBuffer;
 
@@ -61,7 +61,11 @@ public:
     virtual void readRawFrame (const AVFrame*) {}
 
     /** This is called when a frame is due to be displayed according to audio's
-     presentation timestamp PTS as raw frame */
+     presentation timestamp PTS as raw frame. The frame is only valid during the
+     callback. To keep it longer, av_frame_ref it into a frame from the
+     FFmpegFramePool, this doesn't copy the picture.
+     All frames, also the first one after a seek, are sent from the reader's frame
+     presenter thread, one at a time, never from the audio or the decoder threads. */
     virtual void displayNewFrame (const AVFrame*) {}
 
     /** This is called when the video source file has changed */
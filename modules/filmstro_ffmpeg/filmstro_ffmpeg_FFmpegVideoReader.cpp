@@ -50,6 +50,21 @@
 // enable this to print a DBG statement for each packet containing stream ID and timestamp
 //#define DEBUG_LOG_PACKETS
 
+namespace
+{
+    /** the demuxer reads until each packet queue holds this many packets */
+    const int packetsHighWatermark = 25;
+    /** the stream decoders wake the demuxer, when a queue falls below this */
+    const int packetsLowWatermark  = 10;
+    /** in reverse playback the next chunk is decoded, when less than this many seconds are buffered ahead */
+    const double reverseLookAhead  = 1.0;
+    /** reverse playback shows the frames from the frame cache, so it keeps at least this many
+     bytes. The frames not shown yet are kept beyond that, so it only limits the frames passed */
+    const juce::int64 minReverseCacheSize = 256 * 1024 * 1024;
+    /** frames waiting for the listeners in non realtime mode, before showing another one blocks */
+    const size_t maxPresentedFrames = 4;
+}
+
 
 FFmpegVideoReader::FFmpegVideoReader (const int audioFifoSize, const int videoFifoSize)
  :  looping                 (false),
@@ -88,12 +103,47 @@ bool FFmpegVideoReader::loadMovieFile (const File& inputFile)
     return false;
 }
 
+bool FFmpegVideoReader::loadMovieFile (juce::InputStream* input)
+{
+    videoFileName = File();
+    if (input == nullptr) {
+        decoder.closeMovieFile();
+        return false;
+    }
+    return decoder.loadMovieStream (input);
+}
+
+void FFmpegVideoReader::setUseMemoryMapping (const bool shouldMap)
+{
+    decoder.setUseMemoryMapping (shouldMap);
+}
+
 void FFmpegVideoReader::closeMovieFile ()
 {
     decoder.closeMovieFile();
     videoFileName = File();
 }
 
+void FFmpegVideoReader::setThreadingOptions (const int numThreads, const int threadType)
+{
+    decoder.setThreadingOptions (numThreads, threadType);
+}
+
+void FFmpegVideoReader::setIndexCacheDirectory (const juce::File& directory)
+{
+    decoder.setIndexCacheDirectory (directory);
+}
+
+void FFmpegVideoReader::setOpenOptions (const OpenOptions& options)
+{
+    decoder.setOpenOptions (options);
+}
+
+double FFmpegVideoReader::getLastOpenDuration () const
+{
+    return decoder.getLastOpenDuration();
+}
+
 juce::File FFmpegVideoReader::getVideoFileName () const
 {
     return videoFileName;
@@ -135,6 +185,71 @@ double FFmpegVideoReader::getLastVideoPTS () const
     return decoder.getCurrentPTS();
 }
 
+bool FFmpegVideoReader::isSeekIndexReady () const
+{
+    return decoder.getSeekIndex().isReady();
+}
+
+void FFmpegVideoReader::setSeekMode (const SeekMode mode)
+{
+    decoder.setSeekMode (mode);
+}
+
+FFmpegVideoReader::SeekMode FFmpegVideoReader::getSeekMode () const
+{
+    return decoder.getSeekMode();
+}
+
+double FFmpegVideoReader::getLastSeekDuration () const
+{
+    return decoder.getLastSeekDuration();
+}
+
+void FFmpegVideoReader::setScrubbing (const bool shouldScrub)
+{
+    decoder.setScrubbing (shouldScrub);
+}
+
+bool FFmpegVideoReader::isScrubbing () const
+{
+    return decoder.isScrubbing();
+}
+
+void FFmpegVideoReader::stepForward ()
+{
+    if (sampleRate > 0) {
+        const double target = decoder.getStepTarget (1);
+        nextReadPos = static_cast<int64> (target * sampleRate);
+        decoder.requestSeek (target, nullptr, true);
+    }
+}
+
+void FFmpegVideoReader::stepBackward ()
+{
+    if (sampleRate > 0) {
+        const double target = decoder.getStepTarget (-1);
+        nextReadPos = static_cast<int64> (target * sampleRate);
+        decoder.requestSeek (target, nullptr, true);
+    }
+}
+
+void FFmpegVideoReader::setReversePlayback (const bool shouldPlayReversed)
+{
+    if (sampleRate > 0) {
+        decoder.setReversePlayback (shouldPlayReversed, static_cast<double> (nextReadPos) / sampleRate);
+    }
+}
+
+bool FFmpegVideoReader::isPlayingReversed () const
+{
+    return decoder.isPlayingReversed();
+}
+
+void FFmpegVideoReader::setFrameCacheSize (const juce::int64 maxBytes)
+{
+    decoder.setFrameCacheSize (maxBytes);
+}
+
 void FFmpegVideoReader::addVideoListener (FFmpegVideoListener* listener)
 {
     decoder.addVideoListener (listener);
@@ -210,6 +325,7 @@ void FFmpegVideoReader::prepareToPlay (int samplesPerBlockExpected, double newSa
     sampleRate = getVideoSamplingRate();
 
     audioFifo.setSize (numChannels, 192000);
+    decoder.audioFifoCleared();
 
     nextReadPos = 0;
 }
@@ -217,50 +333,110 @@ void FFmpegVideoReader::prepareToPlay (int samplesPerBlockExpected, double newSa
 void FFmpegVideoReader::releaseResources ()
 {
     audioFifo.setSize (2, 8192);
+    decoder.audioFifoCleared();
 }
 
 void FFmpegVideoReader::getNextAudioBlock (const juce::AudioSourceChannelInfo &bufferToFill)
 {
+    readNextAudioBlock (bufferToFill);
+}
+
+int FFmpegVideoReader::readNextAudioBlock (const juce::AudioSourceChannelInfo &bufferToFill)
+{
+    if (decoder.isPlayingReversed() && nextReadPos <= 0) {
+        // playing backwards ended at the start of the file, nothing will be decoded any more
+        bufferToFill.clearActiveBufferRegion();
+        return 0;
+    }
+
     double videoSampleRate = getVideoSamplingRate();
     currentTimeStamp += (bufferToFill.numSamples / videoSampleRate);
 
+    if (decoder.isNonRealtime()) {
+        // offline the caller waits for the data instead of getting silence
+        waitForNextAudioBlockReady (bufferToFill, -1);
+    }
+
     // this triggers also reading of new video frame
     decoder.setCurrentPTS (static_cast<double>(nextReadPos) / sampleRate);
 #ifdef DEBUG_LOG_PACKETS
     DBG ("Play audio block: " + String (nextReadPos) + " PTS: " + String (static_cast<double>(nextReadPos) / sampleRate));
 #endif // DEBUG_LOG_PACKETS
 
-    if (audioFifo.getNumReady() >= bufferToFill.numSamples) {
-        audioFifo.readFromFifo (bufferToFill);
+    if (decoder.isSeeking()) {
+        // the FIFO still holds data of the old position, wait for the seek to finish
+        bufferToFill.clearActiveBufferRegion();
+        return 0;
+    }
+
+    const int numRead = decoder.readFromAudioFifo (bufferToFill);
+    decoder.audioConsumed();
+
+    if (decoder.isPlayingReversed()) {
+        nextReadPos = jmax (int64 (0), nextReadPos - bufferToFill.numSamples);
     }
     else {
-        int numSamples = audioFifo.getNumReady();
-        if (numSamples > 0) {
-            audioFifo.readFromFifo (bufferToFill, numSamples);
-            bufferToFill.buffer->clear (numSamples, bufferToFill.numSamples - numSamples);
-        }
-        else {
-            bufferToFill.clearActiveBufferRegion();
-        }
+        nextReadPos += bufferToFill.numSamples;
     }
-
-    nextReadPos += bufferToFill.numSamples;
+    return numRead;
 }
 
 bool FFmpegVideoReader::waitForNextAudioBlockReady (const juce::AudioSourceChannelInfo &bufferToFill, const int msecs) const
 {
-    const juce::int64 timeout (Time::getCurrentTime().toMilliseconds() + msecs);
-    while (audioFifo.getNumReady () < bufferToFill.numSamples && Time::getCurrentTime().toMilliseconds() < timeout) {
-        Thread::sleep (5);
+    if (sampleRate <= 0 || ! decoder.isThreadRunning())
+        return false;
+
+    const double endPTS = static_cast<double> (nextReadPos + bufferToFill.numSamples) / sampleRate;
+    const double timeout = Time::getMillisecondCounterHiRes() + msecs;
+    while (! decoder.isReadyToPlay (bufferToFill.numSamples, endPTS)) {
+        const double remaining = msecs < 0 ? -1.0 : timeout - Time::getMillisecondCounterHiRes();
+        if (msecs >= 0 && remaining <= 0.0)
+            return false;
+
+        // the decoders signal after each packet, the slice only guards against a closed file
+        decoder.waitForDecodedData (remaining < 0.0 ? 100 : jmin (100, static_cast<int> (remaining) + 1));
+        if (! decoder.isThreadRunning())
+            return false;
     }
-    return false;
+    return decoder.getNumAudioSamplesReady() >= bufferToFill.numSamples;
+}
+
+void FFmpegVideoReader::setNonRealtime (const bool shouldBeNonRealtime)
+{
+    decoder.setNonRealtime (shouldBeNonRealtime);
+}
+
+bool FFmpegVideoReader::isNonRealtime () const
+{
+    return decoder.isNonRealtime();
+}
+
+bool FFmpegVideoReader::isEndOfStream () const
+{
+    // playing backwards the stream ends at the start
+    if (decoder.isPlayingReversed() && nextReadPos <= 0)
+        return true;
+    return decoder.isEndOfStream();
+}
+
+void FFmpegVideoReader::waitUntilFramesShown ()
+{
+    decoder.waitUntilFramesShown();
 }
 
 void FFmpegVideoReader::setNextReadPosition (juce::int64 newPosition)
+{
+    setNextReadPosition (newPosition, nullptr);
+}
+
+void FFmpegVideoReader::setNextReadPosition (juce::int64 newPosition, std::function<void (bool)> onSeekDone)
 {
     nextReadPos = newPosition;
     if (sampleRate > 0) {
-        decoder.setCurrentPTS (nextReadPos / sampleRate, true);
+        decoder.requestSeek (static_cast<double> (nextReadPos) / sampleRate, onSeekDone);
+    }
+    else if (onSeekDone) {
+        onSeekDone (false);
     }
 }
 
@@ -311,8 +487,12 @@ AVCodecContext* FFmpegVideoReader::getSubtitleContext () const
 FFmpegVideoReader::DecoderThread::DecoderThread (AudioBufferFIFO<float>& fifo, const int videoFifoSize)
   : juce::Thread            ("FFmpeg decoder"),
     audioFifo               (fifo),
-    videoFifoRead           (0),
-    videoFifoWrite          (0),
+    audioSamplesWritten     (0),
+    audioSamplesRead        (0),
+    audioStaleUntil         (0),
+    videoFrames             (videoFifoSize),
+    nonRealtime             (false),
+    endOfFileSerial         (-1),
     formatContext           (nullptr),
     videoContext            (nullptr),
     audioContext            (nullptr),
@@ -321,29 +501,52 @@ FFmpegVideoReader::DecoderThread::DecoderThread (AudioBufferFIFO<float>& fifo, c
     videoStreamIdx          (-1),
     audioStreamIdx          (-1),
     subtitleStreamIdx       (-1),
-    currentPTS              (0)
+    threadBudget            (1),
+    threadType              (FF_THREAD_FRAME | FF_THREAD_SLICE),
+    currentPTS              (0),
+    displayedPTS            (-1.0),
+    seekMode                (SeekToKeyframe),
+    scrubbing               (false),
+    lastScrubTarget         (-1.0),
+    numPendingSeeks         (0),
+    hasDeferredSeek         (false),
+    deferredSeekAccurate    (false),
+    seekSerial              (0),
+    seekTargetPTS           (0.0),
+    seekTargetAccurate      (false),
+    seekKeyframesOnly       (false),
+    seekShownFromCache      (false),
+    frameCacheSize          (frameCache.getMaximumSize()),
+    reverse                 (false),
+    reverseChunkEnd         (0.0),
+    hasReverseChunk         (false),
+    seekStartTime           (0.0),
+    lastSeekDuration        (0.0),
+    openStartTime           (0.0),
+    lastOpenDuration        (0.0),
+    audioDecoder            (*this, AVMEDIA_TYPE_AUDIO),
+    videoDecoder            (*this, AVMEDIA_TYPE_VIDEO),
+    presenter               (*this),
+    useMemoryMapping        (false)
 {
     av_register_all();
 
-    // initialize frame FIFO, set data to NULL
-    videoFrames.resize (videoFifoSize, std::make_pair (0.0, nullptr));
-    for (int i=0; i<videoFrames.size(); ++i) {
-        videoFrames [i].second = av_frame_alloc();
-    }
-
-    audioFrame = av_frame_alloc();
+    displayFrame = framePool->acquireFrame();
+    audioFrame = framePool->acquireFrame();
+    seekFrame = framePool->acquireFrame();
 
+    seekIndex.addListener (this);
 }
 
 FFmpegVideoReader::DecoderThread::~DecoderThread ()
 {
-    stopThread (100); // just in case
+    seekIndex.clear ();
+    seekIndex.removeListener (this);
+    stopDecoding (); // just in case
 
-    for (int i=0; i<videoFrames.size(); ++i) {
-        av_frame_free (&(videoFrames [i].second));
-    }
-
-    av_frame_free (&audioFrame);
+    framePool->releaseFrame (displayFrame);
+    framePool->releaseFrame (audioFrame);
+    framePool->releaseFrame (seekFrame);
 
 }
 
@@ -360,20 +563,91 @@ bool FFmpegVideoReader::DecoderThread::loadMovieFile (const juce::File& inputFil
         closeMovieFile ();
     }
 
-    // open input file, and allocate format context
-    int ret = avformat_open_input (&formatContext, inputFile.getFullPathName().toRawUTF8(), NULL, NULL);
+    openStartTime = Time::getMillisecondCounterHiRes();
+    if (useMemoryMapping) {
+        // falls back to file IO, if the file can't be mapped
+        inputIO = FFmpegInputStreamIO::createForMappedFile (inputFile);
+    }
+    return openMovie (inputFile);
+}
+
+bool FFmpegVideoReader::DecoderThread::loadMovieStream (juce::InputStream* input)
+{
+    if (formatContext) {
+        closeMovieFile ();
+    }
+
+    openStartTime = Time::getMillisecondCounterHiRes();
+    inputIO = new FFmpegInputStreamIO (input, true);
+    return openMovie (File());
+}
+
+void FFmpegVideoReader::DecoderThread::setUseMemoryMapping (const bool shouldMap)
+{
+    useMemoryMapping = shouldMap;
+}
+
+bool FFmpegVideoReader::DecoderThread::openMovie (const juce::File& inputFile)
+{
+    const bool isFile = inputFile.existsAsFile();
+
+    // a cached record lets us skip probing the streams and scanning the keyframes
+    FFmpegIndexCache::Record cachedRecord;
+    bool cacheHit = false;
+    if (isFile && openOptions.reuseStreamInfo) {
+        cacheHit = findCachedStreamInfo (inputFile, cachedRecord);
+    }
+
+    if (inputIO) {
+        if (inputIO->getContext() == nullptr) {
+            inputIO = nullptr;
+            return false;
+        }
+        formatContext = avformat_alloc_context();
+        formatContext->pb = inputIO->getContext();
+        formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
+    // open input file, and allocate format context. With custom IO the name is only a hint for the format
+    const String url = isFile ? inputFile.getFullPathName() : String();
+    AVDictionary* options = nullptr;
+    if (openOptions.probeSize > 0) {
+        av_dict_set_int (&options, "probesize", jmax (openOptions.probeSize, static_cast<juce::int64> (32)), 0);
+    }
+    if (openOptions.analyzeDuration > 0) {
+        av_dict_set_int (&options, "analyzeduration", openOptions.analyzeDuration, 0);
+    }
+    int ret = avformat_open_input (&formatContext, url.toRawUTF8(), NULL, &options);
+    av_dict_free (&options);
     if (ret < 0) {
         DBG ("Opening file failed");
+        inputIO = nullptr;
         return false;
     }
 
+    if (cacheHit) {
+        cacheHit = cachedRecord.applyStreamInfo (formatContext);
+    }
+
     // retrieve stream information
-    if (avformat_find_stream_info (formatContext, NULL) < 0) {
-        return false;
+    if (! cacheHit) {
+        if (avformat_find_stream_info (formatContext, NULL) < 0) {
+            avformat_close_input (&formatContext);
+            inputIO = nullptr;
+            return false;
+        }
+        if (isFile) {
+            rememberStreamInfo (inputFile);
+        }
     }
 
+    // the budget is split between the codecs, audio hardly profits from threads, so it
+    // gets one and video the rest. A budget of 1 keeps both on their decoder threads
+    const int audioThreads = 1;
+    const int videoThreads = threadBudget > 1 ? threadBudget - audioThreads : threadBudget;
+
     // open the streams
-    audioStreamIdx = openCodecContext (&audioContext, AVMEDIA_TYPE_AUDIO, true);
+    audioStreamIdx = openCodecContext (&audioContext, AVMEDIA_TYPE_AUDIO, true, audioThreads);
     if (isPositiveAndBelow (audioStreamIdx, static_cast<int> (formatContext->nb_streams))) {
         uint64_t channel_layout = formatContext->streams [audioStreamIdx]->codecpar->channel_layout;
         audioConverterContext = swr_alloc_set_opts(NULL,  // we're allocating a new context
@@ -390,25 +664,114 @@ bool FFmpegVideoReader::DecoderThread::loadMovieFile (const juce::File& inputFil
             std::cerr << "Error initialising audio converter: " << averrtostr(ret) << std::endl;
     }
 
-    videoStreamIdx = openCodecContext (&videoContext, AVMEDIA_TYPE_VIDEO, true);
+    videoStreamIdx = openCodecContext (&videoContext, AVMEDIA_TYPE_VIDEO, true, videoThreads);
     if (isPositiveAndBelow (videoStreamIdx, static_cast<int> (formatContext->nb_streams))) {
         videoListeners.call (&FFmpegVideoListener::videoSizeChanged, videoContext->width,
                                                                      videoContext->height,
                                                                      videoContext->pix_fmt);
     }
 
-    av_dump_format (formatContext, 0, inputFile.getFullPathName().toRawUTF8(), 0);
+    if (openOptions.dumpFormat) {
+        av_dump_format (formatContext, 0, url.toRawUTF8(), 0);
+    }
+
+    lastOpenDuration = Time::getMillisecondCounterHiRes() - openStartTime;
+    DBG ("Opening took " + String (lastOpenDuration.load()) + " ms" + (cacheHit ? " using cached stream info" : ""));
 
     videoListeners.call (&FFmpegVideoListener::videoFileChanged, inputFile);
 
-    startThread ();
+    startDecoding ();
+
+    if (cacheHit && cachedRecord.indexedStream == videoStreamIdx) {
+        seekIndex.setKeyframes (videoStreamIdx, cachedRecord.keyframes);
+    }
+    else if (isFile) {
+        if (indexCacheDirectory != File()) {
+            pendingCacheRecord = new FFmpegIndexCache::Record();
+            pendingCacheRecord->copyStreamInfo (formatContext);
+            pendingCacheRecord->indexedStream = videoStreamIdx;
+            pendingCacheFile = inputFile;
+        }
+
+        if (videoStreamIdx >= 0) {
+            // if there is no video, the audio can seek precisely without an index
+            seekIndex.buildIndex (inputFile, videoStreamIdx);
+        }
+        else if (pendingCacheRecord) {
+            seekIndexReady (seekIndex);
+        }
+    }
 
     return true;
 }
 
+bool FFmpegVideoReader::DecoderThread::findCachedStreamInfo (const juce::File& inputFile, FFmpegIndexCache::Record& record) const
+{
+    for (auto* remembered : rememberedStreamInfo) {
+        if (remembered->file == inputFile) {
+            if (remembered->size != inputFile.getSize() || remembered->modified != inputFile.getLastModificationTime())
+                break;
+
+            // the index cache has the keyframes as well, which are not kept in memory
+            if (indexCacheDirectory != File() && FFmpegIndexCache (indexCacheDirectory).readRecord (inputFile, record))
+                return true;
+
+            record.copyStreamInfo (remembered->record);
+            return true;
+        }
+    }
+
+    if (indexCacheDirectory != File()) {
+        return FFmpegIndexCache (indexCacheDirectory).readRecord (inputFile, record);
+    }
+    return false;
+}
+
+void FFmpegVideoReader::DecoderThread::rememberStreamInfo (const juce::File& inputFile)
+{
+    const int maxRemembered = 16;
+
+    for (int i=rememberedStreamInfo.size() - 1; i >= 0; --i) {
+        if (rememberedStreamInfo.getUnchecked (i)->file == inputFile) {
+            rememberedStreamInfo.remove (i);
+        }
+    }
+    while (rememberedStreamInfo.size() >= maxRemembered) {
+        rememberedStreamInfo.remove (0);
+    }
+
+    RememberedStreamInfo* info = new RememberedStreamInfo();
+    info->file     = inputFile;
+    info->size     = inputFile.getSize();
+    info->modified = inputFile.getLastModificationTime();
+    info->record.copyStreamInfo (formatContext);
+    rememberedStreamInfo.add (info);
+}
+
 void FFmpegVideoReader::DecoderThread::closeMovieFile ()
 {
-    stopThread(1000);
+    seekIndex.clear ();
+    pendingCacheRecord = nullptr;
+    stopDecoding ();
+    frameCache.clear ();
+    displayedPTS = -1.0;
+    reverse = false;
+    reverseChunks.clear ();
+
+    // seeks that didn't happen are reported as failed
+    std::deque<SeekRequest> cancelled;
+    {
+        ScopedLock lock (seekLock);
+        cancelled.swap (seekRequests);
+        numPendingSeeks = 0;
+        hasDeferredSeek = false;
+    }
+    for (auto& request : cancelled) {
+        if (request.onSeekDone) {
+            request.onSeekDone (false);
+        }
+    }
+    videoFrames.discardAll();
 
     if (videoStreamIdx >= 0) {
         avcodec_free_context (&videoContext);
@@ -427,6 +790,105 @@ void FFmpegVideoReader::DecoderThread::closeMovieFile ()
         swr_free(&audioConverterContext);
     }
     avformat_close_input (&formatContext);
+    // a custom AVIOContext is not closed with the format context
+    inputIO = nullptr;
+}
+
+void FFmpegVideoReader::DecoderThread::setThreadingOptions (const int numThreads, const int newThreadType)
+{
+    threadBudget = jmax (0, numThreads);
+    threadType   = newThreadType;
+}
+
+void FFmpegVideoReader::DecoderThread::setIndexCacheDirectory (const juce::File& directory)
+{
+    indexCacheDirectory = directory;
+}
+
+void FFmpegVideoReader::DecoderThread::setOpenOptions (const OpenOptions& options)
+{
+    openOptions = options;
+}
+
+double FFmpegVideoReader::DecoderThread::getLastOpenDuration () const
+{
+    return lastOpenDuration;
+}
+
+void FFmpegVideoReader::DecoderThread::setSeekMode (const SeekMode mode)
+{
+    seekMode = mode;
+}
+
+FFmpegVideoReader::SeekMode FFmpegVideoReader::DecoderThread::getSeekMode () const
+{
+    return seekMode;
+}
+
+double FFmpegVideoReader::DecoderThread::getLastSeekDuration () const
+{
+    return lastSeekDuration;
+}
+
+void FFmpegVideoReader::DecoderThread::setScrubbing (const bool shouldScrub)
+{
+    if (scrubbing.exchange (shouldScrub) == shouldScrub)
+        return;
+
+    if (shouldScrub) {
+        lastScrubTarget = -1.0;
+    }
+    else if (lastScrubTarget >= 0.0) {
+        // the user let go, replace the keyframe with the exact frame
+        queueSeek ({lastScrubTarget, true, false, false, nullptr});
+    }
+}
+
+bool FFmpegVideoReader::DecoderThread::isScrubbing () const
+{
+    return scrubbing;
+}
+
+void FFmpegVideoReader::DecoderThread::setFrameCacheSize (const juce::int64 maxBytes)
+{
+    frameCacheSize = maxBytes;
+    frameCache.setMaximumSize (reverse ? jmax (maxBytes, minReverseCacheSize) : maxBytes);
+}
+
+void FFmpegVideoReader::DecoderThread::setReversePlayback (const bool shouldPlayReversed, const double pts)
+{
+    if (reverse.exchange (shouldPlayReversed) != shouldPlayReversed) {
+        // the reversed frames are only shown from the cache, a disabled or small one is
+        // enlarged until playback goes forward again
+        frameCache.setMaximumSize (shouldPlayReversed ? jmax (frameCacheSize.load(), minReverseCacheSize) : frameCacheSize.load());
+        frameCache.setReversePlayHead (shouldPlayReversed ? pts : -1.0);
+        // restart decoding in the new direction from the current position, even if cached
+        queueSeek ({pts, true, false, false, nullptr});
+    }
+}
+
+bool FFmpegVideoReader::DecoderThread::isPlayingReversed () const
+{
+    return reverse;
+}
+
+void FFmpegVideoReader::DecoderThread::seekFinished ()
+{
+    lastSeekDuration = Time::getMillisecondCounterHiRes() - seekStartTime;
+#ifdef DEBUG_LOG_PACKETS
+    DBG ("Seek took " + String (lastSeekDuration.load()) + " ms");
+#endif /* DEBUG_LOG_PACKETS */
+}
+
+void FFmpegVideoReader::DecoderThread::seekIndexReady (FFmpegSeekIndex& index)
+{
+    if (pendingCacheRecord) {
+        pendingCacheRecord->keyframes = index.getKeyframes();
+        if (! FFmpegIndexCache (indexCacheDirectory).writeRecord (pendingCacheFile, *pendingCacheRecord)) {
+            DBG ("Could not write index cache for " + pendingCacheFile.getFileName());
+        }
+        pendingCacheRecord = nullptr;
+    }
 }
 
 void FFmpegVideoReader::DecoderThread::addVideoListener (FFmpegVideoListener* listener)
@@ -441,7 +903,8 @@ void FFmpegVideoReader::DecoderThread::removeVideoListener (FFmpegVideoListener*
 
 int FFmpegVideoReader::DecoderThread::openCodecContext (AVCodecContext** decoderContext,
                                                         enum AVMediaType type,
-                                                        bool refCounted)
+                                                        bool refCounted,
+                                                        const int numThreads)
 {
     AVCodec *decoder = NULL;
     AVDictionary *opts = NULL;
@@ -469,6 +932,11 @@ int FFmpegVideoReader::DecoderThread::openCodecContext (AVCodecContext** decoder
                  " codec parameters to decoder context");
             return -1;
         }
+        // 1 decodes on the calling thread, 0 lets the codec choose the number of threads
+        (*decoderContext)->thread_count = numThreads;
+        (*decoderContext)->thread_type  = threadType;
+        // the pictures are recycled, the audio frames are copied into the FIFO anyway
+        framePool->useForDecoder (*decoderContext, decoder);
         // Init the decoders, with or without reference counting
         av_dict_set (&opts, "refcounted_frames", refCounted ? "1" : "0", 0);
         if (avcodec_open2 (*decoderContext, decoder, &opts) < 0) {
@@ -491,6 +959,11 @@ int FFmpegVideoReader::DecoderThread::decodeAudioPacket (AVPacket packet)
     int decoded   = packet.size;
     int outputNumSamples    = 0;
 
+    if (reverse && ! hasReverseChunk && ! beginReverseChunk()) {
+        // the chunk was cancelled by a seek
+        return 0;
+    }
+
     int response = avcodec_send_packet(audioContext, &packet);
     
     // decode audio frame
@@ -506,7 +979,7 @@ int FFmpegVideoReader::DecoderThread::decodeAudioPacket (AVPacket packet)
         }
 
         int64_t framePTS = av_frame_get_best_effort_timestamp (audioFrame);
-        double  framePTSsecs = static_cast<double> (framePTS) / audioContext->sample_rate;
+        double  framePTSsecs = av_q2d (formatContext->streams [audioStreamIdx]->time_base) * framePTS;
 
 #ifdef DEBUG_LOG_PACKETS
         DBG ("Stream " + String (packet.stream_index) +
@@ -519,20 +992,44 @@ int FFmpegVideoReader::DecoderThread::decodeAudioPacket (AVPacket packet)
         if (audioFrame->extended_data != nullptr) {
             const int channels   = av_get_channel_layout_nb_channels (audioFrame->channel_layout);
             const int numSamples = audioFrame->nb_samples;
-            audioConvertBuffer.setSize(channels, numSamples, false, false, true);
-            int offset = (currentPTS - framePTSsecs) * audioContext->sample_rate;
-            if (offset > 100) {
-                if (offset < numSamples) {
-                    swr_convert(audioConverterContext, (uint8_t**)audioConvertBuffer.getArrayOfWritePointers(), numSamples, (const uint8_t**)audioFrame->extended_data, numSamples);
-                    outputNumSamples = numSamples-offset;
-                    audioFifo.addToFifo(audioConvertBuffer, outputNumSamples, offset);
-                }
-            }
-            else {
-                outputNumSamples = numSamples;
+            int offset = 0;
+
+            if (hasReverseChunk) {
+                audioConvertBuffer.setSize(channels, numSamples, false, false, true);
                 swr_convert(audioConverterContext, (uint8_t**)audioConvertBuffer.getArrayOfWritePointers(), numSamples, (const uint8_t**)audioFrame->extended_data, numSamples);
-                audioFifo.addToFifo (audioConvertBuffer);
+                collectReverseAudio (framePTSsecs, numSamples);
+                continue;
+            }
+
+            const double target = audioDecoder.seekTarget;
+            if (target >= 0.0 && framePTS != AV_NOPTS_VALUE) {
+                // trim to the exact sample of the seek target
+                offset = roundToInt ((target - framePTSsecs) * audioContext->sample_rate);
+                if (offset >= numSamples) {
+                    // frame ends before the target, drop it without converting
+                    continue;
+                }
+                audioDecoder.seekTarget = -1.0;
+                if (offset < 0) {
+                    // the first frame starts after the target, fill the gap to keep audio in sync
+                    const int silence = jmin (-offset, audioFifo.getFreeSpace() - numSamples);
+                    if (silence > 0) {
+                        audioConvertBuffer.setSize (channels, silence, false, false, true);
+                        audioConvertBuffer.clear();
+                        addToAudioFifo (audioConvertBuffer, 0, silence);
+                        outputNumSamples += silence;
+                    }
+                    offset = 0;
+                }
+                if (videoStreamIdx < 0) {
+                    seekFinished();
+                }
             }
+
+            audioConvertBuffer.setSize(channels, numSamples, false, false, true);
+            swr_convert(audioConverterContext, (uint8_t**)audioConvertBuffer.getArrayOfWritePointers(), numSamples, (const uint8_t**)audioFrame->extended_data, numSamples);
+            addToAudioFifo (audioConvertBuffer, offset, numSamples - offset);
+            outputNumSamples += numSamples - offset;
         }
     }
     
@@ -551,8 +1048,16 @@ double FFmpegVideoReader::DecoderThread::decodeVideoPacket (AVPacket packet)
     
     double pts_sec = 0.0;
     while (response >= 0) {
-        int got_picture = 0;
-        AVFrame* frame = videoFrames [videoFifoWrite].second;
+        // while seeking the queue may be full of stale frames nobody consumes, e.g. when paused
+        const bool seeking = videoDecoder.seekTarget >= 0.0;
+        AVFrame* frame = (seeking || reverse) ? seekFrame : videoFrames.getWriteFrame();
+        while (frame == nullptr) {
+            // a packet can hold more than one frame, wait until the consumer made space
+            if (videoDecoder.threadShouldExit() || videoDecoder.serial != seekSerial)
+                return pts_sec;
+            frameConsumed.wait (-1);
+            frame = videoFrames.getWriteFrame();
+        }
 
         response = avcodec_receive_frame(videoContext, frame);
         if (response >= 0) {
@@ -563,9 +1068,50 @@ double FFmpegVideoReader::DecoderThread::decodeVideoPacket (AVPacket packet)
                 timeBase = formatContext->streams [videoStreamIdx]->time_base;
             }
             pts_sec = av_q2d (timeBase) * pts;
-            if (pts_sec >= 0.0) {
-                videoFrames [videoFifoWrite].first = pts_sec;
-                videoFifoWrite = ++videoFifoWrite % videoFrames.size();
+
+            double duration = av_frame_get_pkt_duration (frame) * av_q2d (timeBase);
+            if (duration <= 0.0) {
+                const double fps = getFramesPerSecond();
+                duration = fps > 0.0 ? 1.0 / fps : 0.0;
+            }
+
+            if (pts != AV_NOPTS_VALUE && pts_sec >= 0.0) {
+                // keep it for scrubbing back, even if it is not displayed now
+                frameCache.insert (frame, pts_sec, duration);
+            }
+
+            if (reverse) {
+                // reverse playback displays the frames from the cache only
+                av_frame_unref (frame);
+                continue;
+            }
+
+            const double target = videoDecoder.seekTarget;
+            if (target >= 0.0) {
+                if (pts_sec + duration <= target) {
+                    // this frame ends before the seek target, it will never be displayed
+                    av_frame_unref (frame);
+                    continue;
+                }
+                videoDecoder.seekTarget = -1.0;
+                seekFinished();
+
+                // show the new position right away, the player might be paused
+                if (videoDecoder.announceSeekTarget) {
+                    showFrame (frame, pts_sec);
+                }
+            }
+
+            if (frame == seekFrame) {
+                AVFrame* queued = videoFrames.getWriteFrame();
+                if (queued != nullptr && pts_sec >= 0.0) {
+                    av_frame_move_ref (queued, seekFrame);
+                    videoFrames.finishedWrite (pts_sec, videoDecoder.serial);
+                }
+                av_frame_unref (seekFrame);
+            }
+            else if (pts_sec >= 0.0) {
+                videoFrames.finishedWrite (pts_sec, videoDecoder.serial);
             }
 
 #ifdef DEBUG_LOG_PACKETS
@@ -587,12 +1133,24 @@ void FFmpegVideoReader::DecoderThread::run()
 {
     int error = 0;
     while (!threadShouldExit()) {
-        int freeVideoFrames = (videoFrames.size() + videoFifoWrite - videoFifoRead) % videoFrames.size();
-        if (audioFifo.getFreeSpace() > 2048 && (audioFifo.getNumReady() < 4096 || freeVideoFrames < videoFrames.size() - 2)) {
+        if (processSeekRequests()) {
+            // after a seek there is something to read again
+            error = 0;
+        }
+
+        if (reverse) {
+            if (! processReverseChunk()) {
+                // setCurrentPTS wakes us, when the play head comes close to the last chunk
+                waitForPacket.wait (-1);
+            }
+            continue;
+        }
+
+        if (needsMorePackets (packetsHighWatermark)) {
 
 #ifdef DEBUG_LOG_PACKETS
-            DBG ("Audio: " + String (audioFifo.getNumReady()) + " ready, "
-                 + String (audioFifo.getFreeSpace()) + " free");
+            DBG ("Queued packets audio: " + String (audioDecoder.packets.getNumPackets()) +
+                 ", video: " + String (videoDecoder.packets.getNumPackets()));
 #endif /* DEBUG_LOG_PACKETS */
 
             AVPacket packet;
@@ -605,10 +1163,10 @@ void FFmpegVideoReader::DecoderThread::run()
 
             if (error >= 0) {
                 if (packet.stream_index == audioStreamIdx) {
-                    decodeAudioPacket (packet);
+                    audioDecoder.packets.push (&packet, seekSerial);
                 }
                 else if(packet.stream_index == videoStreamIdx) {
-                    decodeVideoPacket (packet);
+                    videoDecoder.packets.push (&packet, seekSerial);
                 }
                 else {
                     //DBG ("Packet is neither audio nor video... stream: " + String (packet.stream_index));
@@ -617,59 +1175,794 @@ void FFmpegVideoReader::DecoderThread::run()
             av_packet_unref (&packet);
         }
         else {
-            waitForPacket.wait (20);
+            // the stream decoders wake us, when a queue fell below the low watermark
+            waitForPacket.wait (-1);
+        }
+        const bool endOfFile = error == AVERROR_EOF || (error < 0 && formatContext->pb && avio_feof (formatContext->pb));
+        if (endOfFile && numPendingSeeks == 0) {
+            if (endOfFileSerial != seekSerial) {
+                // let the decoders drain the frames buffered in the codecs
+                endOfFileSerial = seekSerial.load();
+                if (audioStreamIdx >= 0)
+                    audioDecoder.packets.pushDrainMarker (seekSerial);
+                if (videoStreamIdx >= 0)
+                    videoDecoder.packets.pushDrainMarker (seekSerial);
+            }
+            // nothing to do until the next seek
+            waitForPacket.wait (-1);
         }
-        if (error < 0) {
-            // probably EOF, but keep checking from time to time
+        else if (error < 0 && numPendingSeeks == 0) {
+            // e.g. a network hiccup, try again later
             waitForPacket.wait (500);
         }
     }
 }
 
-void FFmpegVideoReader::DecoderThread::setCurrentPTS (const double pts, bool seek)
+bool FFmpegVideoReader::DecoderThread::processSeekRequests ()
 {
-    if (audioContext && seek) {
-        int64_t readPos = pts * audioContext->sample_rate;
-        av_seek_frame (formatContext, audioStreamIdx, readPos, 0);
-        // invalidate all FIFOs
-        audioFifo.reset();
-        videoFifoWrite = 0;
-        videoFifoRead = 0;
-        for (int i=0; i < videoFrames.size(); ++i) {
-            videoFrames [i].first = 0.0;
-        }
-        waitForPacket.signal();
-        Thread::wait (20);
+    if (numPendingSeeks == 0)
+        return false;
+
+    std::deque<SeekRequest> requests;
+    {
+        ScopedLock lock (seekLock);
+        requests.swap (seekRequests);
     }
 
-    videoListeners.call (&FFmpegVideoListener::presentationTimestampChanged, pts);
+    if (requests.empty())
+        return false;
 
-    // find highest PTS < currentPTS
-    auto availableFrames = (videoFrames.size() + videoFifoWrite - videoFifoRead) % videoFrames.size();
-    if (availableFrames < 1) {
+    // only the latest target matters, seeking to the others would just flush again
+    const SeekRequest& latest = requests.back();
+    const bool success = performSeek (latest);
+    numPendingSeeks -= static_cast<int> (requests.size());
+
+    for (auto& request : requests) {
+        if (request.onSeekDone) {
+            request.onSeekDone (&request == &latest ? success : false);
+        }
+    }
+    return true;
+}
+
+bool FFmpegVideoReader::DecoderThread::performSeek (const SeekRequest& request)
+{
+    if (formatContext == nullptr)
+        return false;
+
+    const double pts = request.pts;
+    seekTargetPTS = pts;
+    seekTargetAccurate = request.accurate;
+    seekKeyframesOnly = request.keyframesOnly;
+    seekShownFromCache = request.shownFromCache;
+
+    int ret = 0;
+    FFmpegSeekIndex::Entry keyframe;
+    if (reverse) {
+        // processReverseChunk seeks to the GOP before the position
+        reverseChunkEnd = pts;
+        ScopedLock lock (reverseLock);
+        reverseChunks.clear();
+    }
+    else if (seekIndex.findKeyframe (pts, keyframe)) {
+        // go straight to the keyframe at or before the target
+        const int64_t timestamp = keyframe.dts != AV_NOPTS_VALUE ? keyframe.dts : keyframe.pts;
+        ret = av_seek_frame (formatContext, seekIndex.getStreamIndex(), timestamp, AVSEEK_FLAG_BACKWARD);
+    }
+    else if (audioContext) {
+        // the positions are presentation times of the streams, so start_time is already part of them
+        const int64_t readPos = av_rescale_q (static_cast<int64_t> (pts * AV_TIME_BASE), av_make_q (1, AV_TIME_BASE),
+                                              formatContext->streams [audioStreamIdx]->time_base);
+        ret = av_seek_frame (formatContext, audioStreamIdx, readPos, request.accurate ? AVSEEK_FLAG_BACKWARD : 0);
+    }
+    else {
+        ret = av_seek_frame (formatContext, -1, static_cast<int64_t> (pts * AV_TIME_BASE), AVSEEK_FLAG_BACKWARD);
+    }
+
+    if (ret < 0) {
+        DBG ("Seeking to " + String (pts) + " failed");
+    }
+
+    // everything queued so far belongs to the old position. The stream decoders
+    // notice the new serial, flush their codecs and drop the old data
+    audioDecoder.packets.clear();
+    videoDecoder.packets.clear();
+    ++seekSerial;
+
+    audioDecoder.packets.wakeUp();
+    videoDecoder.packets.wakeUp();
+    frameConsumed.signal();
+
+    return ret >= 0;
+}
+
+void FFmpegVideoReader::DecoderThread::requestSeek (const double pts, std::function<void (bool)> onSeekDone,
+                                                    const bool forceAccurate)
+{
+    const bool keyframesOnly = scrubbing && ! forceAccurate;
+    if (keyframesOnly) {
+        lastScrubTarget = pts;
+    }
+
+    // a recently decoded frame can be shown immediately, the seek only prepares playback
+    bool shownFromCache = false;
+    if (videoStreamIdx >= 0) {
+        AVFrame* cached = framePool->acquireFrame();
+        double cachedPTS = 0.0;
+        if (frameCache.getFrame (pts, cached, &cachedPTS)) {
+            showFrame (cached, cachedPTS);
+            shownFromCache = true;
+        }
+        framePool->releaseFrame (cached);
+    }
+
+    const bool accurate = forceAccurate || (seekMode == SeekAccurate && ! keyframesOnly);
+    if (shownFromCache) {
+        // e.g. stepping while paused, the demuxer only needs to move, once playback continues
+        deferredSeekAccurate = accurate;
+        hasDeferredSeek      = true;
+        if (onSeekDone) {
+            onSeekDone (true);
+        }
+        return;
+    }
+
+    queueSeek ({pts, accurate, keyframesOnly, shownFromCache, onSeekDone});
+}
+
+void FFmpegVideoReader::DecoderThread::queueSeek (const SeekRequest& request)
+{
+    {
+        ScopedLock lock (seekLock);
+        hasDeferredSeek = false;
+        seekRequests.push_back (request);
+        ++numPendingSeeks;
+    }
+    seekStartTime = Time::getMillisecondCounterHiRes();
+    waitForPacket.signal();
+}
+
+bool FFmpegVideoReader::DecoderThread::isSeeking () const
+{
+    if (numPendingSeeks > 0)
+        return true;
+
+    return audioStreamIdx >= 0 && audioDecoder.serial != seekSerial;
+}
+
+bool FFmpegVideoReader::DecoderThread::processReverseChunk ()
+{
+    // avoid seeking for every frame in intra only material
+    const double minChunkLength = 0.5;
+    // B-frames can be decoded after packets with a later dts
+    const double reorderMargin = 0.25;
+
+    const double chunkEnd = reverseChunkEnd;
+    if (formatContext == nullptr || chunkEnd <= 0.0 || currentPTS - chunkEnd > reverseLookAhead)
+        return false;
+
+    double chunkStart = jmax (0.0, chunkEnd - 1.0);
+    int ret = 0;
+    FFmpegSeekIndex::Entry keyframe;
+    if (seekIndex.findKeyframe (jmax (0.0, chunkEnd - minChunkLength), keyframe) && keyframe.seconds < chunkEnd) {
+        chunkStart = jmax (0.0, keyframe.seconds);
+        const int64_t timestamp = keyframe.dts != AV_NOPTS_VALUE ? keyframe.dts : keyframe.pts;
+        ret = av_seek_frame (formatContext, seekIndex.getStreamIndex(), timestamp, AVSEEK_FLAG_BACKWARD);
+    }
+    else {
+        ret = av_seek_frame (formatContext, -1, static_cast<int64_t> (chunkStart * AV_TIME_BASE), AVSEEK_FLAG_BACKWARD);
+    }
+
+    if (ret < 0) {
+        DBG ("Seeking to the reverse chunk at " + String (chunkStart) + " failed");
+        reverseChunkEnd = 0.0;
+        return false;
+    }
+
+    const int serial = seekSerial;
+    if (audioStreamIdx >= 0) {
+        ScopedLock lock (reverseLock);
+        reverseChunks.push_back ({chunkStart, chunkEnd, serial});
+    }
+
+    bool audioDone = audioStreamIdx < 0;
+    bool videoDone = videoStreamIdx < 0;
+    while (! (audioDone && videoDone) && ! threadShouldExit() && numPendingSeeks == 0) {
+        AVPacket packet;
+        packet.data = NULL;
+        packet.size = 0;
+        av_init_packet (&packet);
+
+        if (av_read_frame (formatContext, &packet) < 0)
+            break;
+
+        if (packet.stream_index == audioStreamIdx && ! audioDone) {
+            const int64_t timestamp = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+            const double  seconds   = av_q2d (formatContext->streams [audioStreamIdx]->time_base) * timestamp;
+            if (timestamp != AV_NOPTS_VALUE && seconds >= chunkEnd)
+                audioDone = true;
+            else
+                audioDecoder.packets.push (&packet, serial);
+        }
+        else if (packet.stream_index == videoStreamIdx && ! videoDone) {
+            const int64_t timestamp = packet.dts != AV_NOPTS_VALUE ? packet.dts : packet.pts;
+            const double  seconds   = av_q2d (formatContext->streams [videoStreamIdx]->time_base) * timestamp;
+            if (timestamp != AV_NOPTS_VALUE && seconds >= chunkEnd + reorderMargin)
+                videoDone = true;
+            else
+                videoDecoder.packets.push (&packet, serial);
+        }
+        av_packet_unref (&packet);
+    }
+
+    if (audioStreamIdx >= 0)
+        audioDecoder.packets.pushDrainMarker (serial);
+    if (videoStreamIdx >= 0)
+        videoDecoder.packets.pushDrainMarker (serial);
+
+    reverseChunkEnd = chunkStart;
+    return true;
+}
+
+bool FFmpegVideoReader::DecoderThread::beginReverseChunk ()
+{
+    ScopedLock lock (reverseLock);
+    while (! reverseChunks.empty()) {
+        const ReverseChunk chunk = reverseChunks.front();
+        reverseChunks.pop_front();
+        if (chunk.serial == audioDecoder.serial) {
+            currentReverseChunk = chunk;
+            const int numSamples = static_cast<int> (std::ceil ((chunk.end - chunk.start) * audioContext->sample_rate));
+            reverseAudio.setSize (audioContext->channels, jmax (1, numSamples), false, false, true);
+            reverseAudio.clear();
+            hasReverseChunk = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FFmpegVideoReader::DecoderThread::collectReverseAudio (const double framePTS, const int numSamples)
+{
+    const int start = roundToInt ((framePTS - currentReverseChunk.start) * audioContext->sample_rate);
+    const int first = jmax (0, -start);
+    const int last  = jmin (numSamples, reverseAudio.getNumSamples() - start);
+    if (last <= first)
+        return;
+
+    const int channels = jmin (reverseAudio.getNumChannels(), audioConvertBuffer.getNumChannels());
+    for (int channel = 0; channel < channels; ++channel) {
+        reverseAudio.copyFrom (channel, start + first, audioConvertBuffer, channel, first, last - first);
+    }
+}
+
+void FFmpegVideoReader::DecoderThread::finishReverseChunk (enum AVMediaType type)
+{
+    // an empty packet drains the frames still buffered in the codec
+    AVPacket drain;
+    drain.data = NULL;
+    drain.size = 0;
+    av_init_packet (&drain);
+
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        decodeVideoPacket (drain);
+        flushCodec (type);
+        return;
+    }
+
+    if (hasReverseChunk) {
+        decodeAudioPacket (drain);
+    }
+    else if (reverse) {
+        // no audio packet in this chunk, it is played as silence
+        beginReverseChunk();
+    }
+    flushCodec (type);
+
+    if (! hasReverseChunk)
+        return;
+
+    hasReverseChunk = false;
+    const int numSamples = reverseAudio.getNumSamples();
+    reverseAudio.reverse (0, numSamples);
+
+    int written = 0;
+    while (written < numSamples) {
+        if (audioDecoder.threadShouldExit() || audioDecoder.serial != seekSerial)
+            return;
+
+        const int numToWrite = jmin (numSamples - written, audioFifo.getFreeSpace());
+        if (numToWrite > 0) {
+            addToAudioFifo (reverseAudio, written, numToWrite);
+            written += numToWrite;
+        }
+        else {
+            // the play head is still in the previous chunk, audioConsumed wakes us
+            audioDecoder.packets.waitForPacket (-1);
+        }
+    }
+}
+
+void FFmpegVideoReader::DecoderThread::finishStream (enum AVMediaType type)
+{
+    // an empty packet drains the frames still buffered in the codec
+    AVPacket drain;
+    drain.data = NULL;
+    drain.size = 0;
+    av_init_packet (&drain);
+
+    if (type == AVMEDIA_TYPE_AUDIO) {
+        decodeAudioPacket (drain);
+        audioDecoder.finished = true;
+    }
+    else {
+        decodeVideoPacket (drain);
+        videoDecoder.finished = true;
+    }
+    // a drained codec accepts packets only after a flush, e.g. when seeking back
+    flushCodec (type);
+}
+
+bool FFmpegVideoReader::DecoderThread::isFinished () const
+{
+    return numPendingSeeks == 0 &&
+           (audioStreamIdx < 0 || (audioDecoder.finished && audioDecoder.serial == seekSerial)) &&
+           (videoStreamIdx < 0 || (videoDecoder.finished && videoDecoder.serial == seekSerial));
+}
+
+bool FFmpegVideoReader::DecoderThread::isEndOfStream () const
+{
+    return formatContext == nullptr || (isFinished() && getNumAudioSamplesReady() == 0 && videoFrames.getNumReady() == 0);
+}
+
+bool FFmpegVideoReader::DecoderThread::isReadyToPlay (const int numSamples, const double endPTS) const
+{
+    if (isSeeking())
+        return false;
+
+    const bool audioReady = audioStreamIdx < 0 || audioDecoder.finished ||
+                            getNumAudioSamplesReady() >= numSamples;
+
+    // a full queue counts as ready, the consumer has to make space first
+    const int numFrames = videoFrames.getNumReady();
+    const bool videoReady = videoStreamIdx < 0 || videoDecoder.finished || videoFrames.getFreeSpace() <= 1 ||
+                            (numFrames > 0 && videoFrames.getPTS (numFrames - 1) >= endPTS);
+
+    return audioReady && videoReady;
+}
+
+bool FFmpegVideoReader::DecoderThread::waitForDecodedData (const int timeOutMilliseconds) const
+{
+    return dataDecoded.wait (timeOutMilliseconds);
+}
+
+void FFmpegVideoReader::DecoderThread::setNonRealtime (const bool shouldBeNonRealtime)
+{
+    nonRealtime = shouldBeNonRealtime;
+}
+
+bool FFmpegVideoReader::DecoderThread::isNonRealtime () const
+{
+    return nonRealtime;
+}
+
+bool FFmpegVideoReader::DecoderThread::needsMorePackets (const int minPackets) const
+{
+    // same limits as ffplay: stop when both queues have enough packets or use too much memory
+    const juce::int64 maxQueueSize = 15 * 1024 * 1024;
+
+    if (audioDecoder.packets.getTotalSize() + videoDecoder.packets.getTotalSize() > maxQueueSize) {
+        // offline the caller waits for the starving stream, while the other one can't drain
+        return nonRealtime &&
+               ((audioStreamIdx >= 0 && audioDecoder.packets.getNumPackets() == 0) ||
+                (videoStreamIdx >= 0 && videoDecoder.packets.getNumPackets() == 0));
+    }
+
+    const bool audioHungry = audioStreamIdx >= 0 && audioDecoder.packets.getNumPackets() < minPackets;
+    const bool videoHungry = videoStreamIdx >= 0 && videoDecoder.packets.getNumPackets() < minPackets;
+    return audioHungry || videoHungry;
+}
+
+bool FFmpegVideoReader::DecoderThread::canDecodePacket (enum AVMediaType type) const
+{
+    if (reverse) {
+        // a chunk is collected completely, before it is handed on
+        return true;
+    }
+    if (type == AVMEDIA_TYPE_AUDIO) {
+        return audioFifo.getFreeSpace() > 2048;
+    }
+    // while seeking the frames are decoded into seekFrame, the queue may be full of stale frames
+    return videoDecoder.seekTarget >= 0.0 || videoFrames.getFreeSpace() > 1;
+}
+
+void FFmpegVideoReader::DecoderThread::flushCodec (enum AVMediaType type)
+{
+    AVCodecContext* context = type == AVMEDIA_TYPE_AUDIO ? audioContext : videoContext;
+    if (context) {
+        avcodec_flush_buffers (context);
+    }
+}
+
+void FFmpegVideoReader::DecoderThread::startDecoding ()
+{
+    audioDecoder.serial = seekSerial.load();
+    audioDecoder.seekTarget = -1.0;
+    audioDecoder.finished = false;
+    videoDecoder.serial = seekSerial.load();
+    videoDecoder.seekTarget = -1.0;
+    videoDecoder.finished = false;
+    endOfFileSerial = -1;
+
+    if (audioStreamIdx >= 0)
+        audioDecoder.startThread ();
+    if (videoStreamIdx >= 0) {
+        videoDecoder.startThread ();
+        presenter.startThread ();
+    }
+    startThread ();
+}
+
+void FFmpegVideoReader::DecoderThread::stopDecoding ()
+{
+    // all threads wait without timeout, so they need to be woken up to see the exit flag
+    signalThreadShouldExit ();
+    waitForPacket.signal ();
+    stopThread (1000);
+
+    audioDecoder.signalThreadShouldExit ();
+    videoDecoder.signalThreadShouldExit ();
+    audioDecoder.packets.wakeUp ();
+    videoDecoder.packets.wakeUp ();
+    frameConsumed.signal ();
+    dataDecoded.signal ();
+    audioDecoder.stopThread (1000);
+    videoDecoder.stopThread (1000);
+
+    presenter.signalThreadShouldExit ();
+    presenter.clear ();
+    presenter.stopThread (1000);
+
+    audioDecoder.packets.clear ();
+    videoDecoder.packets.clear ();
+}
+
+// ==============================================================================
+// stream decoder threads
+// ==============================================================================
+
+FFmpegVideoReader::DecoderThread::StreamDecoder::StreamDecoder (DecoderThread& ownerToUse, enum AVMediaType typeToDecode)
+  : juce::Thread    (typeToDecode == AVMEDIA_TYPE_AUDIO ? "FFmpeg audio decoder" : "FFmpeg video decoder"),
+    serial          (0),
+    seekTarget      (-1.0),
+    announceSeekTarget (true),
+    finished        (false),
+    owner           (ownerToUse),
+    type            (typeToDecode)
+{
+}
+
+void FFmpegVideoReader::DecoderThread::StreamDecoder::run()
+{
+    while (!threadShouldExit()) {
+        const int currentSerial = owner.seekSerial;
+        if (serial != currentSerial) {
+            // the demuxer seeked, forget the decoded data of the old position
+            owner.flushCodec (type);
+            if (owner.reverse) {
+                seekTarget = -1.0;
+                announceSeekTarget = false;
+            }
+            if (type == AVMEDIA_TYPE_AUDIO) {
+                // the audio thread might be reading, if the seek came after its isSeeking check,
+                // so it drops the old samples itself when it reads next
+                owner.audioStaleUntil = owner.audioSamplesWritten.load();
+                owner.hasReverseChunk = false;
+                if (! owner.reverse) {
+                    seekTarget = owner.seekTargetPTS;
+                }
+            }
+            else if (owner.reverse) {
+                if (owner.videoContext) {
+                    owner.videoContext->skip_frame = AVDISCARD_DEFAULT;
+                }
+            }
+            else {
+                // when seeking to the keyframe, any frame is good, so the target is the beginning
+                seekTarget = owner.seekTargetAccurate ? owner.seekTargetPTS.load() : 0.0;
+                announceSeekTarget = ! owner.seekShownFromCache;
+                // scrubbing skips decoding everything between the keyframes
+                if (owner.videoContext) {
+                    owner.videoContext->skip_frame = owner.seekKeyframesOnly ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+                }
+            }
+            finished = false;
+            serial = currentSerial;
+        }
+
+        if (! owner.canDecodePacket (type)) {
+            // output is full, the consumer wakes us when it fell below the low watermark
+            packets.waitForPacket (-1);
+            continue;
+        }
+
+        AVPacket packet;
+        packet.data = NULL;
+        packet.size = 0;
+        av_init_packet (&packet);
+
+        int packetSerial = 0;
+        if (packets.pop (&packet, packetSerial)) {
+            if (packetSerial != serial) {
+                // demuxed before the last seek
+                av_packet_unref (&packet);
+                continue;
+            }
+            if (FFmpegPacketQueue::isDrainMarker (packet)) {
+                if (owner.reverse)
+                    owner.finishReverseChunk (type);
+                else
+                    owner.finishStream (type);
+            }
+            else if (type == AVMEDIA_TYPE_AUDIO) {
+                owner.decodeAudioPacket (packet);
+            }
+            else {
+                owner.decodeVideoPacket (packet);
+            }
+            av_packet_unref (&packet);
+            owner.dataDecoded.signal();
+
+            if (owner.needsMorePackets (packetsLowWatermark)) {
+                // refill before the queues run dry
+                owner.waitForPacket.signal();
+            }
+        }
+        else {
+            packets.waitForPacket (-1);
+        }
+    }
+}
+
+void FFmpegVideoReader::DecoderThread::setCurrentPTS (const double pts, bool seek)
+{
+    if (seek) {
+        requestSeek (pts);
+    }
+
+    if (hasDeferredSeek.exchange (false)) {
+        // playback continues from the play head, the frame there is already displayed from the cache
+        queueSeek ({pts, deferredSeekAccurate.load(), false, true, nullptr});
+    }
+
+    currentPTS = pts;
+    videoListeners.call (&FFmpegVideoListener::presentationTimestampChanged, pts);
+
+    if (isSeeking()) {
+        // the frames in the queue are from before the seek
+        return;
+    }
+
+    if (reverse) {
+        // the frames were decoded chunk by chunk into the cache, the ones passed are evicted first
+        frameCache.setReversePlayHead (pts);
+        double framePTS = 0.0;
+        if (frameCache.getFrame (pts, displayFrame, &framePTS, false) && framePTS != displayedPTS) {
+            showFrame (displayFrame, framePTS);
+        }
+        if (reverseChunkEnd > 0.0 && pts - reverseChunkEnd <= reverseLookAhead) {
+            waitForPacket.signal();
+        }
+        return;
+    }
+
+    if (videoFrames.discardOtherSerials (seekSerial) > 0) {
+        videoFramesConsumed();
+    }
+
+    if (nonRealtime) {
+        // offline every frame is delivered, none is dropped
+        while (videoFrames.getNumReady() > 0 && videoFrames.getPTS (0) <= pts) {
+            const double framePTS = videoFrames.getPTS (0);
+            videoFrames.popFrame (0, displayFrame);
+            videoFramesConsumed();
+            showFrame (displayFrame, framePTS);
+        }
+        return;
+    }
+
+    if (videoFrames.getNumReady() < 1) {
         // No frame read!
         DBG ("No frame available!");
-        currentPTS = pts;
         return;
     }
 
-    auto read = videoFifoRead.load();
-    auto i=0;
+    // find the latest frame that is due
+    const int index = videoFrames.findFrameForPTS (pts);
+    if (index >= 0) {
+        if (index > 0) {
+            DBG ("Dropped " + String (index) + " frame(s)");
+        }
+        const double framePTS = videoFrames.getPTS (index);
+        videoFrames.popFrame (index, displayFrame);
+        videoFramesConsumed();
 
-    while ((videoFrames [(read + i) % videoFrames.size()].first < pts) && i < (availableFrames - 1)) {
-        ++i;
+        showFrame (displayFrame, framePTS);
     }
+}
 
-    currentPTS = pts;
-    if (i > 0 || seek) {
-        if (i > 1) {
-            DBG ("Dropped " + String (i-1) + " frame(s)");
+void FFmpegVideoReader::DecoderThread::addToAudioFifo (const juce::AudioBuffer<float>& samples, const int startSample, const int numSamples)
+{
+    audioFifo.addToFifo (samples, startSample + numSamples, startSample);
+    audioSamplesWritten += numSamples;
+}
+
+void FFmpegVideoReader::DecoderThread::skipStaleAudio ()
+{
+    const int64 numStale = audioStaleUntil.load() - audioSamplesRead.load();
+    if (numStale <= 0)
+        return;
+
+    // the stale samples are the oldest ones, the new position follows them
+    int start1, size1, start2, size2;
+    audioFifo.prepareToRead (static_cast<int> (jmin (numStale, static_cast<int64> (audioFifo.getNumReady()))),
+                             start1, size1, start2, size2);
+    audioFifo.finishedRead (size1 + size2);
+    audioSamplesRead += numStale;
+}
+
+int FFmpegVideoReader::DecoderThread::getNumAudioSamplesReady () const
+{
+    const int64 numStale = jmax (int64 (0), audioStaleUntil.load() - audioSamplesRead.load());
+    return static_cast<int> (jmax (int64 (0), audioFifo.getNumReady() - numStale));
+}
+
+void FFmpegVideoReader::DecoderThread::audioFifoCleared ()
+{
+    audioSamplesRead    = audioSamplesWritten.load();
+    audioStaleUntil     = audioSamplesWritten.load();
+}
+
+void FFmpegVideoReader::DecoderThread::audioConsumed ()
+{
+    if (audioFifo.getNumReady() < audioFifo.getTotalSize() / 2) {
+        audioDecoder.packets.wakeUp();
+    }
+}
+
+void FFmpegVideoReader::DecoderThread::videoFramesConsumed ()
+{
+    frameConsumed.signal();
+    if (videoFrames.getNumReady() <= videoFrames.getSize() / 2) {
+        videoDecoder.packets.wakeUp();
+    }
+}
+
+void FFmpegVideoReader::DecoderThread::showFrame (const AVFrame* frame, const double pts)
+{
+    displayedPTS = pts;
+    // offline every frame counts, in realtime only the latest one
+    presenter.present (frame, nonRealtime);
+}
+
+void FFmpegVideoReader::DecoderThread::waitUntilFramesShown ()
+{
+    presenter.waitUntilShown ();
+}
+
+int FFmpegVideoReader::DecoderThread::readFromAudioFifo (const juce::AudioSourceChannelInfo& info)
+{
+    skipStaleAudio();
+    const int numSamples = jmin (audioFifo.getNumReady(), info.numSamples);
+    if (numSamples > 0) {
+        audioFifo.readFromFifo (info, numSamples);
+        audioSamplesRead += numSamples;
+    }
+    if (numSamples < info.numSamples) {
+        info.buffer->clear (info.startSample + numSamples, info.numSamples - numSamples);
+    }
+    return numSamples;
+}
+
+// ==============================================================================
+// frame presenter
+// ==============================================================================
+
+FFmpegVideoReader::DecoderThread::FramePresenter::FramePresenter (DecoderThread& ownerToUse)
+  : juce::Thread    ("FFmpeg frame presenter"),
+    owner           (ownerToUse),
+    presenting      (false)
+{
+}
+
+FFmpegVideoReader::DecoderThread::FramePresenter::~FramePresenter ()
+{
+    signalThreadShouldExit ();
+    queueChanged.notify_all ();
+    stopThread (1000);
+    clear ();
+}
+
+void FFmpegVideoReader::DecoderThread::FramePresenter::present (const AVFrame* frame, const bool keepAll)
+{
+    AVFrame* queued = owner.framePool->acquireFrame();
+    if (queued == nullptr || av_frame_ref (queued, frame) < 0) {
+        owner.framePool->releaseFrame (queued);
+        return;
+    }
+
+    std::deque<AVFrame*> replaced;
+    {
+        std::unique_lock<std::mutex> lock (queueMutex);
+        if (keepAll) {
+            queueChanged.wait (lock, [this] { return frames.size() < maxPresentedFrames || threadShouldExit(); });
+        }
+        else {
+            replaced.swap (frames);
         }
-        videoFifoRead = (read + i) % videoFrames.size();
-        AVFrame* nextFrame = videoFrames [videoFifoRead].second;
+        frames.push_back (queued);
+    }
+    queueChanged.notify_all ();
+
+    for (auto* frameToDrop : replaced)
+        owner.framePool->releaseFrame (frameToDrop);
+}
+
+void FFmpegVideoReader::DecoderThread::FramePresenter::waitUntilShown ()
+{
+    std::unique_lock<std::mutex> lock (queueMutex);
+    queueChanged.wait (lock, [this] { return (frames.empty() && ! presenting) || ! isThreadRunning(); });
+}
 
-        videoListeners.call (&FFmpegVideoListener::displayNewFrame, nextFrame);
+void FFmpegVideoReader::DecoderThread::FramePresenter::clear ()
+{
+    std::deque<AVFrame*> dropped;
+    {
+        std::lock_guard<std::mutex> lock (queueMutex);
+        dropped.swap (frames);
     }
+    queueChanged.notify_all ();
+
+    for (auto* frame : dropped)
+        owner.framePool->releaseFrame (frame);
+}
+
+void FFmpegVideoReader::DecoderThread::FramePresenter::run ()
+{
+    while (! threadShouldExit()) {
+        AVFrame* frame = nullptr;
+        {
+            std::unique_lock<std::mutex> lock (queueMutex);
+            queueChanged.wait (lock, [this] { return ! frames.empty() || threadShouldExit(); });
+            if (threadShouldExit())
+                break;
+
+            frame = frames.front();
+            frames.pop_front();
+            presenting = true;
+        }
+
+        owner.videoListeners.call (&FFmpegVideoListener::displayNewFrame, frame);
+        owner.framePool->releaseFrame (frame);
+
+        {
+            std::lock_guard<std::mutex> lock (queueMutex);
+            presenting = false;
+        }
+        queueChanged.notify_all ();
+    }
+}
+
+double FFmpegVideoReader::DecoderThread::getStepTarget (const int numFrames) const
+{
+    const double fps = getFramesPerSecond();
+    const double frameDuration = fps > 0.0 ? 1.0 / fps : 0.04;
+    const double current = displayedPTS >= 0.0 ? displayedPTS.load() : currentPTS.load();
+
+    // aim a bit into the frame, so rounding of the timestamps doesn't hit the neighbour
+    const double target = current + (numFrames + 0.25) * frameDuration;
+    const double duration = getDuration();
+    return jlimit (0.0, duration > 0.0 ? duration : target, target);
 }
 
 double FFmpegVideoReader::DecoderThread::getCurrentPTS () const
@@ -677,6 +1970,11 @@ double FFmpegVideoReader::DecoderThread::getCurrentPTS () const
     return currentPTS;
 }
 
+const FFmpegSeekIndex& FFmpegVideoReader::DecoderThread::getSeekIndex () const
+{
+    return seekIndex;
+}
+
 int FFmpegVideoReader::DecoderThread::getVideoWidth () const
 {
     if (videoContext) {
@@ -749,7 +2047,7 @@ double FFmpegVideoReader::DecoderThread::getSampleRate () const
 double FFmpegVideoReader::DecoderThread::getDuration () const
 {
     if (formatContext) {
-        return formatContext->duration / AV_TIME_BASE;
+        return static_cast<double> (formatContext->duration) / AV_TIME_BASE;
     }
     return 0;
 }
@@ -42,6 +42,9 @@
 #define FILMSTRO_FFMPEG_FFMPEGVIDEOREADER_H_INCLUDED
 
 #include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 
 /**
  \class         FFmpegVideoReader
@@ -62,15 +65,53 @@ public:
     FFmpegVideoReader (const int audioFifoSize=192000, const int videoFifoSize=20);
     virtual ~FFmpegVideoReader();
 
+    /** How precise a seek should be */
+    enum SeekMode
+    {
+        /** show the keyframe before the target, this is the fastest */
+        SeekToKeyframe = 0,
+        /** decode from the keyframe and show the frame at the target, audio starts at the exact sample */
+        SeekAccurate
+    };
+
+    /** Options for opening files, to trade the accuracy of the stream detection
+     against the time it takes to open. Opening files on network storage profits most. */
+    struct OpenOptions
+    {
+        OpenOptions ()
+          : probeSize (0),
+            analyzeDuration (0),
+            dumpFormat (true),
+            reuseStreamInfo (true)
+        {}
+
+        /** maximum number of bytes read to detect the format and the streams, 0 uses ffmpeg's default */
+        juce::int64 probeSize;
+
+        /** maximum duration in microseconds analysed to find the stream parameters, 0 uses ffmpeg's default */
+        juce::int64 analyzeDuration;
+
+        /** prints the stream information to the log after opening */
+        bool        dumpFormat;
+
+        /** reuses the stream information of a file, that was opened before, from memory or
+         from the index cache directory, instead of probing the streams again */
+        bool        reuseStreamInfo;
+    };
+
     // ==============================================================================
     // video decoder thread
     // ==============================================================================
     /**
      \class         FFmpegVideoReader::DecoderThread
      \description   class for FFmpegReader to decode audio and images asynchronously
-                    This is to keep the audio thread as fast as possible
+                    This is to keep the audio thread as fast as possible.
+                    The DecoderThread itself only demuxes the packets into a queue
+                    for each stream. Audio and video are decoded each on their own
+                    StreamDecoder thread, so a slow video frame doesn't delay audio.
      */
-    class DecoderThread : public juce::Thread
+    class DecoderThread : public juce::Thread,
+                          public FFmpegSeekIndex::Listener
     {
     public:
         DecoderThread (AudioBufferFIFO<float>& fifo, const int videoFifoSize);
@@ -79,8 +120,48 @@ public:
 
         bool loadMovieFile (const juce::File& inputFile);
 
+        /** Opens the media read from input, the decoder takes ownership of the stream */
+        bool loadMovieStream (juce::InputStream* input);
+
         void closeMovieFile ();
 
+        /** If set, files are memory mapped instead of read with file IO */
+        void setUseMemoryMapping (const bool shouldMap);
+
+        /** Set the number of threads and the threading type (FF_THREAD_FRAME and/or
+         FF_THREAD_SLICE) for the codecs, before opening a file. */
+        void setThreadingOptions (const int numThreads, const int threadType);
+
+        /** Set a directory to cache stream information and keyframe index of loaded files */
+        void setIndexCacheDirectory (const juce::File& directory);
+
+        /** Set the probing limits for the next files to open */
+        void setOpenOptions (const OpenOptions& options);
+
+        /** returns the time in milliseconds the last file took to open, until decoding started */
+        double getLastOpenDuration () const;
+
+        void setSeekMode (const SeekMode mode);
+
+        SeekMode getSeekMode () const;
+
+        /** returns the time in milliseconds from the last seek request until the first frame was decoded */
+        double getLastSeekDuration () const;
+
+        /** While scrubbing seeks only show keyframes. Ending the scrub refines to
+         the exact frame of the last seek target */
+        void setScrubbing (const bool shouldScrub);
+
+        bool isScrubbing () const;
+
+        /** Sets the memory budget in bytes for recently decoded frames, 0 disables the cache */
+        void setFrameCacheSize (const juce::int64 maxBytes);
+
+        /** Switches between forward and reverse decoding, starting at pts */
+        void setReversePlayback (const bool shouldPlayReversed, const double pts);
+
+        bool isPlayingReversed () const;
+
         void addVideoListener (FFmpegVideoListener* listener);
 
         void removeVideoListener (FFmpegVideoListener* listener);
@@ -88,12 +169,70 @@ public:
         /** working loop */
         void run() override;
 
-        /** set the currently played PTS according to the audio stream */
+        /** set the currently played PTS according to the audio stream. If seek is
+         true, a seek to pts is requested first. */
         void setCurrentPTS (const double pts, bool seek = false);
 
+        /** Queues a seek to pts in seconds. The seek is done on the decoder thread and
+         the callback is called from there, once the old data was dropped. This never blocks.
+         If the frame at pts is in the frame cache, it is shown right away and the callback is
+         called immediately. The demuxer seek is then deferred until setCurrentPTS is called
+         again, i.e. until playback resumes, so stepping through cached frames never seeks. */
+        void requestSeek (const double pts, std::function<void (bool)> onSeekDone = nullptr,
+                          const bool forceAccurate = false);
+
+        /** Reads the next block from the audio FIFO and fills what is missing with
+         silence. Returns the number of samples read. */
+        int readFromAudioFifo (const juce::AudioSourceChannelInfo& info);
+
+        /** Returns the samples in the audio FIFO, that belong to the current position */
+        int getNumAudioSamplesReady () const;
+
+        /** Call this after the reader resized the audio FIFO, which empties it */
+        void audioFifoCleared ();
+
+        /** Call this after reading from the audio FIFO. It wakes the audio decoder,
+         when the FIFO fell below half */
+        void audioConsumed ();
+
+        /** Blocks until the frame presenter handed all queued frames to the listeners */
+        void waitUntilFramesShown ();
+
+        /** In non realtime mode every decoded frame is displayed, none is dropped */
+        void setNonRealtime (const bool shouldBeNonRealtime);
+
+        bool isNonRealtime () const;
+
+        /** Returns true, when numSamples are in the audio FIFO and all frames until
+         endPTS were decoded, or the decoders reached the end of the file */
+        bool isReadyToPlay (const int numSamples, const double endPTS) const;
+
+        /** Blocks until a decoder processed a packet or the timeout expired */
+        bool waitForDecodedData (const int timeOutMilliseconds) const;
+
+        /** Returns true, once both decoders drained their codecs at the end of the file */
+        bool isFinished () const;
+
+        /** Returns true, once the decoders finished and all samples and frames were consumed */
+        bool isEndOfStream () const;
+
+        /** Returns the timestamp to seek to, to show the frame numFrames after the one
+         displayed last. Use negative values to step backwards */
+        double getStepTarget (const int numFrames) const;
+
+        /** Returns true, while a seek was requested, but the audio FIFO doesn't hold
+         data of the new position yet */
+        bool isSeeking () const;
+
         /** returns the presentation timestamp the video is synchronised to */
         double getCurrentPTS () const;
 
+        /** returns the keyframe index of the video stream */
+        const FFmpegSeekIndex& getSeekIndex () const;
+
+        /** writes the finished index to the index cache */
+        void seekIndexReady (FFmpegSeekIndex&) override;
+
         /** get the width of the video images according to decoder */
         int getVideoWidth () const;
 
@@ -133,27 +272,199 @@ public:
 
         int openCodecContext (AVCodecContext** decoderContext,
                               enum AVMediaType type,
-                              bool refCounted);
+                              bool refCounted,
+                              const int numThreads);
 
         /** Returns the number of added samples to the audio FIFO */
         int decodeAudioPacket (AVPacket packet);
 
+        /** Adds samples to the audio FIFO and counts them, called by the audio decoder only */
+        void addToAudioFifo (const juce::AudioBuffer<float>& samples, const int startSample, const int numSamples);
+
+        /** Skips the samples of the old position after a seek, called by the audio thread only */
+        void skipStaleAudio ();
+
         /** Returns the presentation timecode PTS of the decoded frame */
         double decodeVideoPacket (AVPacket packet);
 
+        /** Opens the format context, either from inputIO or from the file, and starts decoding */
+        bool openMovie (const juce::File& inputFile);
+
+        /** Looks for stream information of the file in memory and in the index cache */
+        bool findCachedStreamInfo (const juce::File& inputFile, FFmpegIndexCache::Record& record) const;
+
+        /** Keeps the stream information of the opened file in memory, so reopening skips probing */
+        void rememberStreamInfo (const juce::File& inputFile);
+
+        /** Returns true, if a stream has less than minPackets queued and the queues
+         are not using too much memory. In non realtime mode an empty queue is filled
+         regardless of the memory, because the caller waits for that stream */
+        bool needsMorePackets (const int minPackets) const;
+
+        /** wakes the video decoder, when the frame queue fell below half */
+        void videoFramesConsumed ();
+
+        /** Executes the latest queued seek request, the older ones are superseded.
+         Returns true if there were any */
+        bool processSeekRequests ();
+
+        struct SeekRequest
+        {
+            double                      pts;
+            bool                        accurate;
+            bool                        keyframesOnly;
+            bool                        shownFromCache;
+            std::function<void (bool)>  onSeekDone;
+        };
+
+        /** Seeks the demuxer and drops all queued packets */
+        bool performSeek (const SeekRequest& request);
+
+        /** Hands the request to the demuxer thread and drops a deferred seek */
+        void queueSeek (const SeekRequest& request);
+
+        /** In reverse playback, demuxes the GOP before the last chunk and queues its
+         packets followed by a drain marker. Returns false, if nothing needs to be read */
+        bool processReverseChunk ();
+
+        /** takes the bounds of the next reverse chunk for the audio decoder */
+        bool beginReverseChunk ();
+
+        /** copies the converted samples of a frame into the reverse chunk buffer */
+        void collectReverseAudio (const double framePTS, const int numSamples);
+
+        /** drains the codec at the end of a reverse chunk and moves the reversed audio to the FIFO */
+        void finishReverseChunk (enum AVMediaType type);
+
+        /** drains the codec at the end of the file and marks the stream as finished */
+        void finishStream (enum AVMediaType type);
+
+        /** Returns true, if the output of the stream decoder has space for another packet */
+        bool canDecodePacket (enum AVMediaType type) const;
+
+        /** Drops the frames buffered in the codec, e.g. after seeking */
+        void flushCodec (enum AVMediaType type);
+
+        /** called by the decoders, when the first frame after a seek is available */
+        void seekFinished ();
+
+        /** hands the frame to the listeners and remembers its timestamp for frame stepping */
+        void showFrame (const AVFrame* frame, const double pts);
+
+        // ==============================================================================
+        /**
+         \class         FFmpegVideoReader::DecoderThread::FramePresenter
+         \description   calls displayNewFrame of the listeners, always from the same thread
+
+         Frames to show come from the video decoder, the audio thread and from seek
+         requests. The presenter keeps a reference to them and hands them on from its
+         own thread, so the listeners don't need to be thread safe.
+         */
+        class FramePresenter : public juce::Thread
+        {
+        public:
+            FramePresenter (DecoderThread& owner);
+
+            ~FramePresenter ();
+
+            /** Queues a reference to frame. If keepAll is false, a frame that was not shown
+             yet is replaced, otherwise this blocks while too many frames are waiting. */
+            void present (const AVFrame* frame, const bool keepAll);
+
+            /** Blocks until all queued frames were handed to the listeners */
+            void waitUntilShown ();
+
+            /** Drops the frames, that were not shown yet */
+            void clear ();
+
+            /** working loop */
+            void run () override;
+
+        private:
+            DecoderThread&              owner;
+
+            std::mutex                  queueMutex;
+            std::condition_variable     queueChanged;
+            std::deque<AVFrame*>        frames;
+            bool                        presenting;
+
+            JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FramePresenter)
+        };
+
+        // ==============================================================================
+        /**
+         \class         FFmpegVideoReader::DecoderThread::StreamDecoder
+         \description   decodes the packets of one stream, that were queued by the demuxer
+         */
+        class StreamDecoder : public juce::Thread
+        {
+        public:
+            StreamDecoder (DecoderThread& owner, enum AVMediaType type);
+
+            /** working loop */
+            void run() override;
+
+            /** packets demuxed for this stream waiting to be decoded */
+            FFmpegPacketQueue   packets;
+
+            /** the seek the decoded data belongs to. If it differs from the
+             demuxer's seekSerial, the codec is flushed before decoding on. */
+            std::atomic<int>    serial;
+
+            /** decoded frames ending before this timestamp are dropped, negative if not seeking */
+            double              seekTarget;
+
+            /** false, if the frame at the seek target was already displayed from the cache */
+            bool                announceSeekTarget;
+
+            /** set, when the last packet of the file was decoded for the current serial */
+            std::atomic<bool>   finished;
+
+        private:
+            DecoderThread&      owner;
+            enum AVMediaType    type;
+
+            JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StreamDecoder)
+        };
+
+        void startDecoding ();
+
+        void stopDecoding ();
+
 
         // ==============================================================================
 
 
         /** has access to the audio sources fifo to fill it */
         AudioBufferFIFO<float>& audioFifo;
+
+        /** Counts the samples ever added to and read from the audio FIFO. After a seek the
+         audio decoder marks everything written so far as stale and the audio thread skips
+         it, so only the audio thread moves the read position and never waits for a lock */
+        std::atomic<juce::int64> audioSamplesWritten;
+        std::atomic<juce::int64> audioSamplesRead;
+        std::atomic<juce::int64> audioStaleUntil;
         
         juce::WaitableEvent waitForPacket;
 
-        /** vector of PTS -> AVFrame tuples */
-        std::vector<std::pair<double, AVFrame*> > videoFrames;
-        std::atomic<int>    videoFifoRead;
-        std::atomic<int>    videoFifoWrite;
+        /** decoded frames in presentation order, waiting to be displayed */
+        FFmpegFrameQueue    videoFrames;
+
+        /** signalled when a frame was taken out of videoFrames */
+        juce::WaitableEvent frameConsumed;
+
+        /** signalled by the stream decoders after each packet, for non realtime consumers */
+        juce::WaitableEvent dataDecoded;
+
+        std::atomic<bool>   nonRealtime;
+
+        /** the serial, for which the demuxer reached the end of the file, -1 if none */
+        std::atomic<int>    endOfFileSerial;
+
+        /** the frame that was handed to the listeners last */
+        AVFrame*            displayFrame;
+
+        juce::SharedResourcePointer<FFmpegFramePool> framePool;
 
         AVFormatContext*    formatContext;
         AVCodecContext*     videoContext;
@@ -165,16 +476,113 @@ public:
         int                 audioStreamIdx;
         int                 subtitleStreamIdx;
 
+        /** number of codec threads for audio and video together, 0 lets ffmpeg decide */
+        int                 threadBudget;
+        int                 threadType;
+
         AVFrame*            audioFrame;
         juce::AudioBuffer<float>  audioConvertBuffer;
 
+        /** frames decoded while searching the seek target, independent of the frame queue */
+        AVFrame*            seekFrame;
+
         std::atomic<double> currentPTS;
 
+        /** presentation timestamp of the frame handed to the listeners last, negative if none */
+        std::atomic<double> displayedPTS;
+
+        SeekMode            seekMode;
+
+        std::atomic<bool>   scrubbing;
+        std::atomic<double> lastScrubTarget;
+
+        juce::CriticalSection       seekLock;
+        std::deque<SeekRequest>     seekRequests;
+        std::atomic<int>            numPendingSeeks;
+
+        /** a seek answered from the frame cache, that is executed when playback continues */
+        std::atomic<bool>           hasDeferredSeek;
+        std::atomic<bool>           deferredSeekAccurate;
+
+        /** incremented by the demuxer with each seek, packets and frames carry the serial of their seek */
+        std::atomic<int>    seekSerial;
+
+        /** target of the last executed seek, read by the stream decoders when the serial changes */
+        std::atomic<double> seekTargetPTS;
+        std::atomic<bool>   seekTargetAccurate;
+        std::atomic<bool>   seekKeyframesOnly;
+        std::atomic<bool>   seekShownFromCache;
+
+        /** recently decoded frames, so seeking back and forth needs no decoding */
+        FFmpegFrameCache    frameCache;
+        /** the size set with setFrameCacheSize, reverse playback may use a bigger cache */
+        std::atomic<juce::int64> frameCacheSize;
+
+        /** The reverse playback decodes chunks from a keyframe up to the start of the
+         previous chunk. The audio of a chunk is reversed as a whole, the video frames
+         are displayed from the frameCache, which drops the frames passed before the
+         chunks waiting ahead of the play head */
+        struct ReverseChunk
+        {
+            double  start;
+            double  end;
+            int     serial;
+        };
+
+        std::atomic<bool>           reverse;
+
+        /** the start of the last queued chunk, where the next chunk has to end */
+        std::atomic<double>         reverseChunkEnd;
+
+        juce::CriticalSection       reverseLock;
+        std::deque<ReverseChunk>    reverseChunks;
+
+        /** used by the audio decoder only */
+        bool                        hasReverseChunk;
+        ReverseChunk                currentReverseChunk;
+        juce::AudioBuffer<float>    reverseAudio;
+
+        std::atomic<double> seekStartTime;
+        std::atomic<double> lastSeekDuration;
+
+        OpenOptions         openOptions;
+        double              openStartTime;
+        std::atomic<double> lastOpenDuration;
+
+        /** stream information of recently opened files, identified by name, size and modification time */
+        struct RememberedStreamInfo
+        {
+            juce::File              file;
+            juce::int64             size;
+            juce::Time              modified;
+            FFmpegIndexCache::Record record;
+        };
+        juce::OwnedArray<RememberedStreamInfo> rememberedStreamInfo;
+
         juce::ListenerList<FFmpegVideoListener> videoListeners;
 
         /** Buffer for reading */
         juce::AudioBuffer<float> buffer;
 
+        StreamDecoder       audioDecoder;
+        StreamDecoder       videoDecoder;
+
+        FramePresenter      presenter;
+
+        /** custom IO, if the media is not opened by file name */
+        juce::ScopedPointer<FFmpegInputStreamIO> inputIO;
+        bool                useMemoryMapping;
+
+        /** directory of the FFmpegIndexCache, no caching if it is not set */
+        juce::File          indexCacheDirectory;
+
+        /** stream information of the loaded file, written to the cache when the index is ready */
+        juce::ScopedPointer<FFmpegIndexCache::Record> pendingCacheRecord;
+        juce::File          pendingCacheFile;
+
+        /** keyframes of the video stream, built in the background after loading */
+        FFmpegSeekIndex     seekIndex;
+
     };
 
     // ==============================================================================
@@ -183,8 +591,38 @@ public:
 
     bool    loadMovieFile (const juce::File& inputFile);
 
+    /** Opens the media from an InputStream, e.g. a MemoryInputStream of embedded data.
+     The reader takes ownership of the stream. The stream should be seekable. Streams are
+     not indexed in the background, so seeking is less precise than with files. */
+    bool    loadMovieFile (juce::InputStream* input);
+
     void    closeMovieFile ();
 
+    /** If set, files are memory mapped and read directly from memory. On POSIX systems
+     the kernel reads ahead of the play position. This takes effect for the next file. */
+    void    setUseMemoryMapping (const bool shouldMap);
+
+    /** Set the number of threads the codecs of audio and video use for decoding together.
+     The audio decoder gets one of them, the video decoder the rest. The default of 1
+     decodes each stream on its decoder thread without additional threads, a numThreads
+     of 0 lets ffmpeg choose for the video according to the number of cores. The
+     threadType can be FF_THREAD_FRAME, FF_THREAD_SLICE or both. This takes effect when
+     the next file is loaded. */
+    void    setThreadingOptions (const int numThreads, const int threadType = FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    /** Set a directory to keep the stream information and the keyframe index of
+     loaded files. Reopening a file, that is in the cache, skips probing the streams
+     and building the index. Set an invalid File to disable the cache, which is
+     the default. */
+    void    setIndexCacheDirectory (const juce::File& directory);
+
+    /** Set limits for probing the streams and whether to reuse the stream information
+     of files, that were opened before. This takes effect when the next file is loaded. */
+    void    setOpenOptions (const OpenOptions& options);
+
+    /** Returns the time in milliseconds the last loadMovieFile took */
+    double  getLastOpenDuration () const;
+
     /** Returns the currently opened video file */
     juce::File getVideoFileName () const;
 
@@ -220,6 +658,51 @@ public:
 
     double getLastVideoPTS () const;
 
+    /** Returns true, once the keyframe index was built. Before that seeking is less precise */
+    bool    isSeekIndexReady () const;
+
+    /** Set how precise seeking should be. SeekAccurate decodes from the keyframe to the
+     target frame and drops the frames before without displaying them. */
+    void    setSeekMode (const SeekMode mode);
+
+    /** Returns the current seek mode */
+    SeekMode getSeekMode () const;
+
+    /** Returns the time in milliseconds the last seek took until the first frame to
+     display was decoded */
+    double  getLastSeekDuration () const;
+
+    /** Call this when the user starts and stops dragging a position slider. While
+     scrubbing, only the latest seek is executed and only keyframes are decoded.
+     When scrubbing ends, the reader refines to the exact frame of the last position. */
+    void    setScrubbing (const bool shouldScrub);
+
+    /** Returns true, while the reader is in scrub mode */
+    bool    isScrubbing () const;
+
+    /** Shows the next frame and moves the read position there. Use it while paused */
+    void    stepForward ();
+
+    /** Shows the previous frame and moves the read position there. A cache miss decodes
+     the GOP up to the frame once, so the following steps back are taken from the frame cache.
+     Those do not seek the demuxer, it is moved once playback continues */
+    void    stepBackward ();
+
+    /** Plays the video backwards from the current read position. The audio blocks are
+     reversed and getNextReadPosition counts down. The reader decodes whole GOPs ahead
+     of the play head and shows the frames from the frame cache, so while playing
+     backwards the cache holds at least 256 MB, even if it was disabled. Frames not
+     shown yet are kept beyond that, so long GOPs take more memory for a while. At the
+     start of the file isEndOfStream turns true */
+    void    setReversePlayback (const bool shouldPlayReversed);
+
+    /** Returns true, if the video plays backwards */
+    bool    isPlayingReversed () const;
+
+    /** Set the memory budget in bytes for recently decoded frames. Seeking to a
+     cached frame displays it without decoding. 0 disables the cache, the default is 256 MB */
+    void    setFrameCacheSize (const juce::int64 maxBytes);
+
     /** get the width of the video images according to decoder */
     int getVideoWidth () const;
 
@@ -253,12 +736,40 @@ public:
     /** decodes packets to fill the audioFifo. If a video packet is found it will be forwarded to VideoDecoderThread */
     void 	getNextAudioBlock (const juce::AudioSourceChannelInfo &bufferToFill) override;
 
-    /** Wait until the decoder thread has finished enough data. This is needed for non-realtime processing. */
+    /** Same as getNextAudioBlock, but returns the number of samples, that were decoded.
+     The rest of the block is filled with silence, e.g. at the end of the file */
+    int     readNextAudioBlock (const juce::AudioSourceChannelInfo &bufferToFill);
+
+    /** Blocks until the samples for the next block and all frames up to its end are
+     decoded. Returns true, if the whole block is ready, false after the timeout or at
+     the end of the file. A negative msecs waits without timeout. */
     bool    waitForNextAudioBlockReady (const juce::AudioSourceChannelInfo &bufferToFill, const int msecs) const;
 
-    /** Seeks in the stream */
+    /** In non realtime mode getNextAudioBlock blocks until the data is decoded and every
+     video frame is delivered to the listeners. Use this for offline processing, which
+     then runs as fast as decoding allows. */
+    void    setNonRealtime (const bool shouldBeNonRealtime);
+
+    bool    isNonRealtime () const;
+
+    /** Returns true, when all samples and frames of the file were read or no file is
+     open. In reverse playback it returns true, once the start of the file is reached.
+     Reading on returns silence. */
+    bool    isEndOfStream () const;
+
+    /** The video listeners get the frames from a thread of their own. This blocks until
+     all frames, that are due, were handed to them, e.g. before closing a writer, that
+     listens to the reader. */
+    void    waitUntilFramesShown ();
+
+    /** Seeks in the stream. The seek is executed asynchronously on the decoder thread,
+     until it is done getNextAudioBlock returns silence. */
     void 	setNextReadPosition (juce::int64 newPosition) override;
 
+    /** Seeks in the stream and calls onSeekDone from the decoder thread, once the
+     data of the old position was dropped. This call never blocks. */
+    void    setNextReadPosition (juce::int64 newPosition, std::function<void (bool)> onSeekDone);
+
     /** Returns the sample count of the next sample to be returned by getNextAudioBlock */
     juce::int64 	getNextReadPosition () const override;
 
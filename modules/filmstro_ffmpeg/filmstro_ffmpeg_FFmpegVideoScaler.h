@@ -112,6 +112,22 @@ public:
     }
 
 
+    /** Scales and converts an AVFrame into another AVFrame, e.g. to match an encoder.
+     The destination needs to have the buffers allocated. */
+    void convertFrameToFrame (AVFrame* destination, const AVFrame* source)
+    {
+        if (scalerContext) {
+            sws_scale (scalerContext,
+                       source->data,
+                       source->linesize,
+                       0,
+                       source->height,
+                       destination->data,
+                       destination->linesize);
+        }
+    }
+
+
     /** Converts a JUCE Image into a ffmpeg AVFrame to be written into a video stream */
     void convertImageToFrame (AVFrame* frame, const juce::Image& image)
     {
@@ -40,9 +40,295 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 
+namespace
+{
+    /** Returns the size of the NAL length fields, if packets of that stream carry
+     length prefixed NAL units like in mp4 (avcC or hvcC extradata), otherwise 0 */
+    int getNalLengthSize (const AVCodecParameters* parameters)
+    {
+        if (parameters->extradata == nullptr || parameters->extradata [0] != 1)
+            return 0;
+        if (parameters->codec_id == AV_CODEC_ID_H264 && parameters->extradata_size >= 7)
+            return (parameters->extradata [4] & 3) + 1;
+        if (parameters->codec_id == AV_CODEC_ID_HEVC && parameters->extradata_size >= 23)
+            return (parameters->extradata [21] & 3) + 1;
+        return 0;
+    }
+
+    void writeNalUnit (MemoryOutputStream& out, const uint8_t* data, const int size, const int lengthSize)
+    {
+        for (int i = lengthSize - 1; i >= 0; --i)
+            out.writeByte (static_cast<char> ((size >> (8 * i)) & 0xff));
+        out.write (data, static_cast<size_t> (size));
+    }
+
+    /** Returns the SPS and PPS (and VPS) of the extradata as length prefixed NAL units */
+    MemoryBlock getParameterSets (const AVCodecParameters* parameters, const int lengthSize)
+    {
+        MemoryBlock block;
+        MemoryOutputStream out (block, false);
+        const uint8_t* data = parameters->extradata;
+        const int      size = parameters->extradata_size;
+
+        auto readNalUnits = [&] (int& pos, const int numUnits)
+        {
+            for (int i=0; i < numUnits && pos + 2 <= size; ++i) {
+                const int length = (data [pos] << 8) | data [pos + 1];
+                pos += 2;
+                if (pos + length > size)
+                    return;
+                writeNalUnit (out, data + pos, length, lengthSize);
+                pos += length;
+            }
+        };
+
+        if (parameters->codec_id == AV_CODEC_ID_H264) {
+            int pos = 6;
+            readNalUnits (pos, data [5] & 0x1f);
+            if (pos < size) {
+                const int numPPS = data [pos++];
+                readNalUnits (pos, numPPS);
+            }
+        }
+        else if (parameters->codec_id == AV_CODEC_ID_HEVC) {
+            int pos = 23;
+            const int numArrays = data [22];
+            for (int i=0; i < numArrays && pos + 3 <= size; ++i) {
+                const int numUnits = (data [pos + 1] << 8) | data [pos + 2];
+                pos += 3;
+                readNalUnits (pos, numUnits);
+            }
+        }
+        out.flush();
+        return block;
+    }
+
+    /** Encoders emit Annex B start codes, the copied stream needs length prefixes */
+    MemoryBlock convertAnnexB (const uint8_t* data, const int size, const int lengthSize)
+    {
+        MemoryBlock block;
+        MemoryOutputStream out (block, false);
+
+        auto findStartCode = [&] (int pos)
+        {
+            while (pos + 3 <= size) {
+                if (data [pos] == 0 && data [pos + 1] == 0 && data [pos + 2] == 1)
+                    return pos;
+                ++pos;
+            }
+            return size;
+        };
+
+        int start = findStartCode (0);
+        while (start < size) {
+            const int nalStart = start + 3;
+            int next = findStartCode (nalStart);
+            int nalEnd = next;
+            // a four byte start code and trailing zeros don't belong to the unit
+            while (nalEnd > nalStart && data [nalEnd - 1] == 0)
+                --nalEnd;
+            if (nalEnd > nalStart)
+                writeNalUnit (out, data + nalStart, nalEnd - nalStart, lengthSize);
+            start = next;
+        }
+        out.flush();
+        return block;
+    }
+
+    /** Replaces the payload of packet with data, keeping timestamps and flags */
+    bool setPacketData (AVPacket* packet, const MemoryBlock& data)
+    {
+        AVPacket replaced;
+        replaced.data = NULL;
+        replaced.size = 0;
+        av_init_packet (&replaced);
+        if (av_new_packet (&replaced, static_cast<int> (data.getSize())) < 0)
+            return false;
+
+        memcpy (replaced.data, data.getData(), data.getSize());
+        av_packet_copy_props (&replaced, packet);
+        av_packet_unref (packet);
+        av_packet_move_ref (packet, &replaced);
+        return true;
+    }
+
+    int64_t getPacketPTS (const AVPacket* packet)
+    {
+        return packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    }
+}
+
+/** the state of trimMovieFile, shared between the GOPs */
+struct FFmpegVideoWriter::TrimContext
+{
+    AVFormatContext*    input;
+    const AVStream*     videoStream;
+    const AVStream*     audioStream;
+    AVCodecContext*     videoDecoder;
+    AVCodecContext*     audioDecoder;
+    SwrContext*         resampler;
+    AVFrame*            frame;
+
+    /** the range in the time base of the video stream */
+    int64_t             startTs;
+    int64_t             endTs;
+    double              startSeconds;
+    double              endSeconds;
+
+    /** the encoded packets use the decoding delay of the copied ones, so dts doesn't go backwards */
+    int64_t             decodeDelay;
+
+    /** 0 if the packets carry start codes, otherwise the size of the length prefix */
+    int                 nalLengthSize;
+    /** the parameter sets of the source, repeated after encoded GOPs */
+    MemoryBlock         parameterSets;
+    bool                needsParameterSets;
+
+    /** the leading pictures of an open GOP refer to the GOP before, if that was
+     encoded again, they have to be encoded again as well */
+    bool                previousReencoded;
+
+    juce::int64         numAudioSamples;
+    juce::int64         audioSamplesWritten;
+    AudioBuffer<float>  audioBuffer;
+};
+
+// ==============================================================================
+// encoder thread
+// ==============================================================================
+
+/**
+ Holds the images of writeNextVideoFrame in a bounded queue and encodes them
+ in the order they were submitted
+ */
+class FFmpegVideoWriter::EncoderThread : public juce::Thread
+{
+public:
+    EncoderThread (FFmpegVideoWriter& ownerToUse, const int queueSize, const AsyncPolicy policyToUse)
+      : juce::Thread ("FFmpeg encoder"),
+        owner        (ownerToUse),
+        maxFrames    (jmax (1, queueSize)),
+        policy       (policyToUse),
+        encoding     (false)
+    {
+        startThread ();
+    }
+
+    ~EncoderThread ()
+    {
+        // give the queued frames a chance, but don't hang on a stalled encoder
+        waitUntilEmpty (stopTimeout);
+        signalThreadShouldExit ();
+        {
+            std::lock_guard<std::mutex> lock (queueLock);
+            frameAdded.notify_all ();
+            frameTaken.notify_all ();
+        }
+        stopThread (stopTimeout);
+    }
+
+    /** Copies the image into the queue. Returns false, if the frame was dropped */
+    bool pushFrame (const juce::Image& image, const juce::int64 timestamp)
+    {
+        QueuedFrame queued;
+        queued.image     = image.createCopy();
+        queued.timestamp = timestamp;
+
+        std::unique_lock<std::mutex> lock (queueLock);
+        if (static_cast<int> (frames.size()) >= maxFrames) {
+            if (policy == dropOldestWhenFull) {
+                frames.pop_front();
+                ++owner.numDroppedFrames;
+            }
+            else if (policy == dropNewestWhenFull) {
+                ++owner.numDroppedFrames;
+                return false;
+            }
+            else {
+                frameTaken.wait (lock, [this] { return static_cast<int> (frames.size()) < maxFrames || threadShouldExit(); });
+                if (threadShouldExit()) {
+                    // nobody would encode it any more
+                    ++owner.numDroppedFrames;
+                    return false;
+                }
+            }
+        }
+        frames.push_back (queued);
+        frameAdded.notify_one();
+        return true;
+    }
+
+    /** Blocks until all queued frames are encoded or the timeout in milliseconds
+     passed, a negative timeout waits forever. Returns true, if the queue is empty */
+    bool waitUntilEmpty (const int timeoutMs = -1)
+    {
+        auto isDone = [this] { return (frames.empty() && ! encoding) || threadShouldExit(); };
+        std::unique_lock<std::mutex> lock (queueLock);
+        if (timeoutMs < 0)
+            frameTaken.wait (lock, isDone);
+        else
+            frameTaken.wait_for (lock, std::chrono::milliseconds (timeoutMs), isDone);
+        return frames.empty() && ! encoding;
+    }
+
+    int getNumQueuedFrames () const
+    {
+        std::lock_guard<std::mutex> lock (queueLock);
+        return static_cast<int> (frames.size());
+    }
+
+    void run () override
+    {
+        std::unique_lock<std::mutex> lock (queueLock);
+        while (! threadShouldExit()) {
+            if (frames.empty()) {
+                frameAdded.wait (lock, [this] { return ! frames.empty() || threadShouldExit(); });
+                continue;
+            }
+
+            QueuedFrame queued = frames.front();
+            frames.pop_front();
+            encoding = true;
+
+            lock.unlock();
+            owner.encodeImage (queued.image, queued.timestamp);
+            lock.lock();
+
+            encoding = false;
+            // the pushing and the waiting threads both wait for this
+            frameTaken.notify_all();
+        }
+        encoding = false;
+        frameTaken.notify_all();
+    }
+
+private:
+    struct QueuedFrame
+    {
+        juce::Image         image;
+        juce::int64         timestamp = 0;
+    };
+
+    static const int            stopTimeout = 2000;
+
+    FFmpegVideoWriter&          owner;
+    const int                   maxFrames;
+    const AsyncPolicy           policy;
+
+    mutable std::mutex          queueLock;
+    std::deque<QueuedFrame>     frames;
+    bool                        encoding;
+
+    std::condition_variable     frameAdded;
+    std::condition_variable     frameTaken;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EncoderThread)
+};
+
 FFmpegVideoWriter::FFmpegVideoWriter (const juce::String& format)
  :  audioWritePosition (0),
     formatContext   (nullptr),
+    outputBufferSize (65536),
     videoContext    (nullptr),
     audioContext    (nullptr),
     subtitleContext (nullptr),
@@ -58,12 +344,23 @@ FFmpegVideoWriter::FFmpegVideoWriter (const juce::String& format)
     videoHeight     (0),
     pixelFormat     (AV_PIX_FMT_NONE),
     pixelAspect     (av_make_q (1, 1)),
-    audioFifo       (2, 8192)
+    threadBudget    (1),
+    threadType      (FF_THREAD_FRAME | FF_THREAD_SLICE),
+    audioFifo       (2, 8192),
+    numDroppedFrames (0),
+    numWrittenPackets (0)
 {
     videoTimeBase = av_make_q (1, 24);
     audioTimeBase = av_make_q (1, sampleRate);
     subtitleTimeBase = av_make_q (1, AV_TIME_BASE);
 
+    videoCopy.parameters = nullptr;
+    videoCopy.sourceTimeBase = av_make_q (1, AV_TIME_BASE);
+    videoCopy.inBandParameterSets = false;
+    audioCopy.parameters = nullptr;
+    audioCopy.sourceTimeBase = av_make_q (1, AV_TIME_BASE);
+    audioCopy.inBandParameterSets = false;
+
     av_register_all();
     if (format.isNotEmpty()) {
         formatContext = avformat_alloc_context();
@@ -76,6 +373,9 @@ FFmpegVideoWriter::FFmpegVideoWriter (const juce::String& format)
 
 FFmpegVideoWriter::~FFmpegVideoWriter()
 {
+    // the thread must not encode into the contexts, while they are closed
+    encoderThread = nullptr;
+    clearStreamCopies();
 }
 
 juce::StringArray FFmpegVideoWriter::getOutputFormatNames ()
@@ -99,6 +399,11 @@ void FFmpegVideoWriter::setAudioCodec (const AVCodecID codec)
     audioCodec = codec;
 }
 
+AVCodecID FFmpegVideoWriter::getAudioCodec () const
+{
+    return audioCodec;
+}
+
 void FFmpegVideoWriter::setSubtitleCodec (const AVCodecID codec)
 {
     subtitleCodec = codec;
@@ -110,6 +415,11 @@ void FFmpegVideoWriter::setSampleRate (const int newSampleRate)
     audioTimeBase = av_make_q (1, newSampleRate);
 }
 
+int FFmpegVideoWriter::getSampleRate () const
+{
+    return sampleRate;
+}
+
 void FFmpegVideoWriter::setVideoSize (const int width, const int height)
 {
     videoWidth = width;
@@ -126,6 +436,12 @@ void FFmpegVideoWriter::setPixelAspect (const int num, const int den)
     pixelAspect = av_make_q (num, den);
 }
 
+void FFmpegVideoWriter::setThreadingOptions (const int numThreads, const int newThreadType)
+{
+    threadBudget = jmax (0, numThreads);
+    threadType   = newThreadType;
+}
+
 void FFmpegVideoWriter::setTimeBase (AVMediaType type, AVRational timebase)
 {
     switch (type) {
@@ -143,6 +459,39 @@ void FFmpegVideoWriter::setTimeBase (AVMediaType type, AVRational timebase)
     }
 }
 
+AVRational FFmpegVideoWriter::getTimeBase (AVMediaType type) const
+{
+    switch (type) {
+        case AVMEDIA_TYPE_VIDEO:
+            return videoTimeBase;
+        case AVMEDIA_TYPE_AUDIO:
+            return audioTimeBase;
+        case AVMEDIA_TYPE_SUBTITLE:
+            return subtitleTimeBase;
+        default:
+            return av_make_q (1, AV_TIME_BASE);
+    }
+}
+
+void FFmpegVideoWriter::copySettingsFrom (const FFmpegVideoWriter& other)
+{
+    videoCodec       = other.videoCodec;
+    audioCodec       = other.audioCodec;
+    subtitleCodec    = other.subtitleCodec;
+    videoTimeBase    = other.videoTimeBase;
+    audioTimeBase    = other.audioTimeBase;
+    subtitleTimeBase = other.subtitleTimeBase;
+    sampleRate       = other.sampleRate;
+    channelLayout    = other.channelLayout;
+    videoWidth       = other.videoWidth;
+    videoHeight      = other.videoHeight;
+    pixelFormat      = other.pixelFormat;
+    pixelAspect      = other.pixelAspect;
+    threadBudget     = other.threadBudget;
+    threadType       = other.threadType;
+    outputBufferSize = other.outputBufferSize;
+}
+
 void FFmpegVideoWriter::copySettingsFromContext (const AVCodecContext* context)
 {
     if (context) {
@@ -173,7 +522,136 @@ void FFmpegVideoWriter::copySettingsFromContext (const AVCodecContext* context)
     }
 }
 
+void FFmpegVideoWriter::setOutputBufferSize (const int numBytes)
+{
+    outputBufferSize = jmax (4096, numBytes);
+}
+
+void FFmpegVideoWriter::setStreamCopy (const AVStream* sourceStream)
+{
+    if (sourceStream == nullptr)
+        return;
+
+    const AVMediaType type = sourceStream->codecpar->codec_type;
+    if (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO) {
+        DBG ("Only audio and video streams can be copied");
+        return;
+    }
+
+    StreamCopy& copy = getStreamCopy (type);
+    if (copy.parameters == nullptr)
+        copy.parameters = avcodec_parameters_alloc();
+    avcodec_parameters_copy (copy.parameters, sourceStream->codecpar);
+    copy.sourceTimeBase = sourceStream->time_base;
+    copy.inBandParameterSets = false;
+}
+
+void FFmpegVideoWriter::clearStreamCopies ()
+{
+    avcodec_parameters_free (&videoCopy.parameters);
+    avcodec_parameters_free (&audioCopy.parameters);
+}
+
+bool FFmpegVideoWriter::isStreamCopy (AVMediaType type) const
+{
+    if (type == AVMEDIA_TYPE_VIDEO)
+        return videoCopy.parameters != nullptr;
+    if (type == AVMEDIA_TYPE_AUDIO)
+        return audioCopy.parameters != nullptr;
+    return false;
+}
+
+FFmpegVideoWriter::StreamCopy& FFmpegVideoWriter::getStreamCopy (AVMediaType type)
+{
+    return type == AVMEDIA_TYPE_VIDEO ? videoCopy : audioCopy;
+}
+
+int FFmpegVideoWriter::addCopiedStream (const StreamCopy& copy)
+{
+    AVStream* stream = avformat_new_stream (formatContext, NULL);
+    if (!stream) {
+        DBG ("Failed allocating copied output stream");
+        return -1;
+    }
+    if (avcodec_parameters_copy (stream->codecpar, copy.parameters) < 0) {
+        DBG ("Failed copying the codec parameters");
+        return -1;
+    }
+    // the tags of the source container might mean something else in the output
+    stream->codecpar->codec_tag = 0;
+    if (copy.inBandParameterSets && formatContext->oformat->codec_tag != nullptr) {
+        const AVCodecID codecId = copy.parameters->codec_id;
+        const unsigned int tag  = codecId == AV_CODEC_ID_H264 ? MKTAG ('a', 'v', 'c', '3') : MKTAG ('h', 'e', 'v', '1');
+        if (av_codec_get_id (formatContext->oformat->codec_tag, tag) == codecId)
+            stream->codecpar->codec_tag = tag;
+    }
+    // only a hint, the muxer may choose a different time base in avformat_write_header
+    stream->time_base = copy.sourceTimeBase;
+    return formatContext->nb_streams - 1;
+}
+
+bool FFmpegVideoWriter::writePacket (const AVPacket* packet, AVMediaType type, const juce::int64 offset)
+{
+    const int streamIdx = type == AVMEDIA_TYPE_VIDEO ? videoStreamIdx : audioStreamIdx;
+    if (formatContext == nullptr || packet == nullptr || ! isStreamCopy (type) ||
+        ! isPositiveAndBelow (streamIdx, static_cast<int> (formatContext->nb_streams))) {
+        DBG ("No copied stream open, did not write packet");
+        return false;
+    }
+
+    AVPacket copied;
+    copied.data = NULL;
+    copied.size = 0;
+    av_init_packet (&copied);
+    if (av_packet_ref (&copied, packet) < 0) {
+        DBG ("Could not reference packet to write");
+        return false;
+    }
+
+    copied.stream_index = streamIdx;
+    copied.pos = -1;
+    if (copied.pts != AV_NOPTS_VALUE)
+        copied.pts += offset;
+    if (copied.dts != AV_NOPTS_VALUE)
+        copied.dts += offset;
+    av_packet_rescale_ts (&copied,
+                          getStreamCopy (type).sourceTimeBase,
+                          formatContext->streams [streamIdx]->time_base);
+
+    // the muxer takes over the reference
+    const ScopedLock lock (muxerLock);
+    const int ret = av_interleaved_write_frame (formatContext, &copied);
+    av_packet_unref (&copied);
+    if (ret < 0) {
+        DBG ("Error when writing copied packet");
+        return false;
+    }
+    ++numWrittenPackets;
+    return true;
+}
+
 bool FFmpegVideoWriter::openMovieFile (const juce::File& outputFile, const juce::String& format)
+{
+    outputIO = nullptr;
+    return openMovie (outputFile.getFullPathName(), format);
+}
+
+bool FFmpegVideoWriter::openMovieStream (juce::OutputStream* outputStream, const juce::String& format, const bool takeOwnership)
+{
+    ScopedPointer<FFmpegOutputStreamIO> io = new FFmpegOutputStreamIO (outputStream, takeOwnership, outputBufferSize);
+    if (io->getContext() == nullptr) {
+        DBG ("Could not create the output context for the stream");
+        return false;
+    }
+    if (format.isEmpty() && formatContext == nullptr) {
+        DBG ("A format is needed to write into a stream");
+        return false;
+    }
+    outputIO = io.release();
+    return openMovie (String(), format);
+}
+
+bool FFmpegVideoWriter::openMovie (const juce::String& filename, const juce::String& format)
 {
     videoStreamIdx  = -1;
     if (videoContext) av_free (&videoContext);
@@ -183,42 +661,49 @@ bool FFmpegVideoWriter::openMovieFile (const juce::File& outputFile, const juce:
     if (subtitleContext) av_free (&subtitleContext);
 
     audioWritePosition   = 0;
+    numWrittenPackets    = 0;
+
+    // streams have no name, so the codecs can only be guessed from the format
+    const char* url = filename.isNotEmpty() ? filename.toRawUTF8() : nullptr;
 
     if (formatContext) {
-        String name (outputFile.getFullPathName ());
-        memcpy (formatContext->filename, name.toRawUTF8 (), jmin (name.getNumBytesAsUTF8 () + 1, sizeof (formatContext->filename)));
+        memcpy (formatContext->filename, filename.toRawUTF8 (), jmin (filename.getNumBytesAsUTF8 () + 1, sizeof (formatContext->filename)));
     }
     else {
         if (format.isEmpty())
-            avformat_alloc_output_context2 (&formatContext, NULL, NULL, outputFile.getFullPathName().toRawUTF8());
+            avformat_alloc_output_context2 (&formatContext, NULL, NULL, url);
         else
-            avformat_alloc_output_context2 (&formatContext, NULL, format.toRawUTF8(), outputFile.getFullPathName().toRawUTF8());
+            avformat_alloc_output_context2 (&formatContext, NULL, format.toRawUTF8(), url);
     }
     if (!formatContext) {
         DBG ("Could not open output with format " + format);
+        outputIO = nullptr;
         return false;
     }
 
     if (videoCodec == AV_CODEC_ID_PROBE) {
         videoCodec = av_guess_codec (formatContext->oformat,
-                                     nullptr, outputFile.getFullPathName().toRawUTF8(),
+                                     nullptr, url,
                                      nullptr,
                                      AVMEDIA_TYPE_VIDEO);
     }
     if (audioCodec == AV_CODEC_ID_PROBE) {
         audioCodec = av_guess_codec (formatContext->oformat,
-                                     nullptr, outputFile.getFullPathName().toRawUTF8(),
+                                     nullptr, url,
                                      nullptr,
                                      AVMEDIA_TYPE_AUDIO);
     }
     if (subtitleCodec == AV_CODEC_ID_PROBE) {
         subtitleCodec = av_guess_codec (formatContext->oformat,
-                                        nullptr, outputFile.getFullPathName().toRawUTF8(),
+                                        nullptr, url,
                                         nullptr,
                                         AVMEDIA_TYPE_SUBTITLE);
     }
 
-    if (videoCodec > AV_CODEC_ID_NONE) {
+    if (videoCopy.parameters) {
+        videoStreamIdx = addCopiedStream (videoCopy);
+    }
+    else if (videoCodec > AV_CODEC_ID_NONE) {
         AVStream* stream = avformat_new_stream (formatContext, NULL);
         if (!stream) {
             DBG ("Failed allocating video output stream\n");
@@ -240,6 +725,8 @@ bool FFmpegVideoWriter::openMovieFile (const juce::File& outputFile, const juce:
                 videoContext->bit_rate  = 480000;
                 videoContext->gop_size  = 10;
                 videoContext->max_b_frames = 1;
+                videoContext->thread_count = threadBudget;
+                videoContext->thread_type  = threadType;
                 avcodec_parameters_from_context (stream->codecpar, videoContext);
 
                 AVDictionary* options = nullptr;
@@ -264,7 +751,10 @@ bool FFmpegVideoWriter::openMovieFile (const juce::File& outputFile, const juce:
         }
     }
 
-    if (audioCodec > AV_CODEC_ID_NONE) {
+    if (audioCopy.parameters) {
+        audioStreamIdx = addCopiedStream (audioCopy);
+    }
+    else if (audioCodec > AV_CODEC_ID_NONE) {
         AVStream* stream = avformat_new_stream (formatContext, NULL);
         if (!stream) {
             DBG ("Failed allocating audio output stream\n");
@@ -282,6 +772,9 @@ bool FFmpegVideoWriter::openMovieFile (const juce::File& outputFile, const juce:
                 audioContext->bit_rate = 64000;
                 audioContext->frame_size = 1024;
                 audioContext->bits_per_raw_sample = 32;
+                // audio encoders hardly profit from threads, the budget goes to video
+                audioContext->thread_count = 1;
+                audioContext->thread_type  = threadType;
                 avcodec_parameters_from_context (stream->codecpar, audioContext);
 
                 int ret = avcodec_open2 (audioContext, encoder, NULL);
@@ -303,15 +796,7 @@ bool FFmpegVideoWriter::openMovieFile (const juce::File& outputFile, const juce:
     //    // FIXME: TODO
     //}
 
-    av_dump_format (formatContext, 0, outputFile.getFullPathName().toRawUTF8(), 1);
-
-    if (!(formatContext->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open (&formatContext->pb, outputFile.getFullPathName().toRawUTF8(), AVIO_FLAG_WRITE) < 0) {
-            DBG ("Could not open output file '" + outputFile.getFullPathName() + "'");
-            closeContexts();
-            return false;
-        }
-    }
+    av_dump_format (formatContext, 0, filename.toRawUTF8(), 1);
 
     if (formatContext->oformat->flags & AVFMT_GLOBALHEADER) {
         if (videoContext) videoContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
@@ -319,16 +804,25 @@ bool FFmpegVideoWriter::openMovieFile (const juce::File& outputFile, const juce:
         if (subtitleContext) subtitleContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     }
 
-    if (!videoContext && !audioContext && !subtitleContext) {
+    if (!videoContext && !audioContext && !subtitleContext && videoStreamIdx < 0 && audioStreamIdx < 0) {
         DBG ("No stream provided to encode");
         closeContexts();
         return false;
     }
 
-    if (!(formatContext->oformat->flags & AVFMT_NOFILE)) {
-        int ret = avio_open(&formatContext->pb, outputFile.getFullPathName().toRawUTF8(), AVIO_FLAG_WRITE);
+    if (outputIO) {
+        if (formatContext->oformat->flags & AVFMT_NOFILE) {
+            DBG ("The format " + String (formatContext->oformat->name) + " can't write into a stream");
+            closeContexts();
+            return false;
+        }
+        formatContext->pb = outputIO->getContext();
+        formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    else if (!(formatContext->oformat->flags & AVFMT_NOFILE)) {
+        int ret = avio_open(&formatContext->pb, filename.toRawUTF8(), AVIO_FLAG_WRITE);
         if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Could not open output file '%s'", outputFile.getFullPathName().toRawUTF8());
+            av_log(NULL, AV_LOG_ERROR, "Could not open output file '%s'", filename.toRawUTF8());
             closeContexts();
             return false;
         }
@@ -344,6 +838,429 @@ bool FFmpegVideoWriter::openMovieFile (const juce::File& outputFile, const juce:
     return true;
 }
 
+bool FFmpegVideoWriter::trimMovieFile (const juce::File& inputFile, const juce::File& outputFile,
+                                       const double startSeconds, const double endSeconds,
+                                       const juce::String& format)
+{
+    if (endSeconds <= startSeconds) {
+        DBG ("The trim range is empty");
+        return false;
+    }
+    if (formatContext != nullptr) {
+        DBG ("The writer is busy with another file, close it before trimming");
+        return false;
+    }
+
+    AVFormatContext* input = nullptr;
+    if (avformat_open_input (&input, inputFile.getFullPathName().toRawUTF8(), NULL, NULL) < 0) {
+        DBG ("Could not open " + inputFile.getFullPathName() + " for trimming");
+        return false;
+    }
+    if (avformat_find_stream_info (input, NULL) < 0) {
+        DBG ("Could not find the streams of " + inputFile.getFullPathName());
+        avformat_close_input (&input);
+        return false;
+    }
+
+    const int videoIdx = av_find_best_stream (input, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    const int audioIdx = av_find_best_stream (input, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (videoIdx < 0 || (input->streams [videoIdx]->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+        DBG ("Trimming needs a video stream");
+        avformat_close_input (&input);
+        return false;
+    }
+
+    TrimContext trim;
+    trim.input          = input;
+    trim.videoStream    = input->streams [videoIdx];
+    trim.audioStream    = audioIdx >= 0 && audioCodec > AV_CODEC_ID_NONE ? input->streams [audioIdx] : nullptr;
+    trim.videoDecoder   = nullptr;
+    trim.audioDecoder   = nullptr;
+    trim.resampler      = nullptr;
+    trim.frame          = av_frame_alloc();
+    // the range is relative to the start of the file, e.g. MPEG-TS doesn't start at zero
+    const double fileStart = input->start_time != AV_NOPTS_VALUE ? static_cast<double> (input->start_time) / AV_TIME_BASE : 0.0;
+    trim.startSeconds   = fileStart + startSeconds;
+    trim.endSeconds     = fileStart + endSeconds;
+
+    const AVRational timeBase = trim.videoStream->time_base;
+    trim.startTs = av_rescale_q (static_cast<int64_t> (trim.startSeconds * AV_TIME_BASE), av_make_q (1, AV_TIME_BASE), timeBase);
+    trim.endTs   = av_rescale_q (static_cast<int64_t> (trim.endSeconds * AV_TIME_BASE), av_make_q (1, AV_TIME_BASE), timeBase);
+
+    const AVRational frameRate = av_guess_frame_rate (input, const_cast<AVStream*> (trim.videoStream), nullptr);
+    const int64_t frameDuration = frameRate.num > 0 ? jmax (int64_t (1), av_rescale_q (1, av_inv_q (frameRate), timeBase)) : 1;
+    trim.decodeDelay = trim.videoStream->codecpar->video_delay * frameDuration;
+
+    trim.nalLengthSize = getNalLengthSize (trim.videoStream->codecpar);
+    if (trim.nalLengthSize > 0)
+        trim.parameterSets = getParameterSets (trim.videoStream->codecpar, trim.nalLengthSize);
+    trim.needsParameterSets = false;
+    trim.previousReencoded  = false;
+
+    trim.numAudioSamples     = static_cast<juce::int64> ((endSeconds - startSeconds) * sampleRate);
+    trim.audioSamplesWritten = 0;
+
+    auto openDecoder = [this] (const AVStream* stream) -> AVCodecContext*
+    {
+        AVCodec* decoder = avcodec_find_decoder (stream->codecpar->codec_id);
+        if (decoder == nullptr)
+            return nullptr;
+        AVCodecContext* context = avcodec_alloc_context3 (decoder);
+        avcodec_parameters_to_context (context, stream->codecpar);
+        context->pkt_timebase = stream->time_base;
+        // the video decoder shares the budget with the encoder at the cut points
+        if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+            context->thread_count = threadBudget > 1 ? threadBudget / 2 : threadBudget;
+        else
+            context->thread_count = 1;
+        if (avcodec_open2 (context, decoder, NULL) < 0)
+            avcodec_free_context (&context);
+        return context;
+    };
+
+    trim.videoDecoder = openDecoder (trim.videoStream);
+    if (trim.audioStream) {
+        trim.audioDecoder = openDecoder (trim.audioStream);
+        if (trim.audioDecoder) {
+            const int64_t inLayout = trim.audioDecoder->channel_layout != 0 ? trim.audioDecoder->channel_layout
+                                                                            : av_get_default_channel_layout (trim.audioDecoder->channels);
+            trim.resampler = swr_alloc_set_opts (NULL,
+                                                 AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLTP, sampleRate,
+                                                 inLayout, trim.audioDecoder->sample_fmt, trim.audioDecoder->sample_rate,
+                                                 0, NULL);
+            if (trim.resampler == nullptr || swr_init (trim.resampler) < 0) {
+                DBG ("Could not convert the audio for trimming, dropping it");
+                swr_free (&trim.resampler);
+                avcodec_free_context (&trim.audioDecoder);
+            }
+        }
+    }
+
+    // the stream copies of the caller are put back, when the trim is done
+    const StreamCopy callerVideoCopy = videoCopy;
+    const StreamCopy callerAudioCopy = audioCopy;
+    videoCopy.parameters = nullptr;
+    audioCopy.parameters = nullptr;
+
+    bool success = trim.videoDecoder != nullptr;
+    if (success) {
+        // without audio in the source the output gets no audio stream either
+        const AVCodecID configuredAudioCodec = audioCodec;
+        if (trim.audioDecoder == nullptr)
+            audioCodec = AV_CODEC_ID_NONE;
+
+        setStreamCopy (trim.videoStream);
+        videoCopy.inBandParameterSets = trim.nalLengthSize > 0;
+        success = openMovieFile (outputFile, format);
+        audioCodec = configuredAudioCodec;
+    }
+    else {
+        DBG ("No decoder for the video stream");
+    }
+
+    if (success && av_seek_frame (input, videoIdx, trim.startTs, AVSEEK_FLAG_BACKWARD) < 0) {
+        DBG ("Seeking to the start of the trim range failed, reading from the beginning");
+        av_seek_frame (input, videoIdx, 0, AVSEEK_FLAG_BACKWARD);
+    }
+
+    std::vector<AVPacket*> gop;
+    // kept for the leading pictures of the next GOP
+    std::vector<AVPacket*> previousGOP;
+    bool videoDone = ! success;
+    bool audioDone = trim.audioDecoder == nullptr;
+
+    // a GOP is processed, when the next keyframe shows, where it ends
+    auto finishGOP = [&] (const int64_t nextKeyframe)
+    {
+        if (! gop.empty()) {
+            const int64_t keyframe = getPacketPTS (gop.front());
+            if (keyframe >= trim.endTs) {
+                videoDone = true;
+            }
+            else if (nextKeyframe > trim.startTs) {
+                // pictures of an open GOP, that are shown before its keyframe and refer to the GOP before
+                bool hasLeadingPictures = false;
+                for (auto* packet : gop)
+                    if (packet->pts != AV_NOPTS_VALUE && packet->pts < keyframe)
+                        hasLeadingPictures = true;
+
+                const std::vector<AVPacket*> noReferences;
+                const std::vector<AVPacket*>& references = hasLeadingPictures ? previousGOP : noReferences;
+                const bool inside = keyframe >= trim.startTs && nextKeyframe <= trim.endTs;
+                if (! inside) {
+                    success = reencodeGOP (trim, gop, references, trim.endTs);
+                    trim.previousReencoded = true;
+                }
+                else {
+                    if (hasLeadingPictures && trim.previousReencoded) {
+                        // the copies would refer to the encoded frames, encode them as well
+                        success = reencodeGOP (trim, gop, references, keyframe);
+                    }
+                    success = success && copyGOP (trim, gop);
+                    trim.previousReencoded = false;
+                }
+            }
+            if (! success || nextKeyframe >= trim.endTs)
+                videoDone = true;
+        }
+        for (auto* packet : previousGOP)
+            av_packet_free (&packet);
+        previousGOP.clear();
+        previousGOP.swap (gop);
+    };
+
+    AVPacket packet;
+    packet.data = NULL;
+    packet.size = 0;
+    av_init_packet (&packet);
+    while (success && ! (videoDone && audioDone) && av_read_frame (input, &packet) >= 0) {
+        if (packet.stream_index == videoIdx && ! videoDone) {
+            if (packet.flags & AV_PKT_FLAG_KEY) {
+                finishGOP (getPacketPTS (&packet));
+            }
+            if (! gop.empty() || (packet.flags & AV_PKT_FLAG_KEY)) {
+                AVPacket* queued = av_packet_alloc();
+                av_packet_ref (queued, &packet);
+                gop.push_back (queued);
+            }
+        }
+        else if (trim.audioStream && packet.stream_index == trim.audioStream->index && ! audioDone) {
+            writeTrimmedAudio (trim, &packet);
+            audioDone = trim.audioSamplesWritten >= trim.numAudioSamples;
+        }
+        av_packet_unref (&packet);
+    }
+
+    if (success && ! videoDone) {
+        // the last GOP ends with the file
+        int64_t fileEnd = 0;
+        for (auto* queued : gop)
+            fileEnd = jmax (fileEnd, getPacketPTS (queued) + jmax (queued->duration, frameDuration));
+        finishGOP (fileEnd);
+    }
+    else {
+        finishGOP (0);
+    }
+    for (auto* packet : previousGOP)
+        av_packet_free (&packet);
+
+    if (formatContext)
+        closeMovieFile();
+    clearStreamCopies();
+    videoCopy = callerVideoCopy;
+    audioCopy = callerAudioCopy;
+
+    av_frame_free (&trim.frame);
+    swr_free (&trim.resampler);
+    avcodec_free_context (&trim.videoDecoder);
+    avcodec_free_context (&trim.audioDecoder);
+    avformat_close_input (&input);
+    return success;
+}
+
+bool FFmpegVideoWriter::copyGOP (TrimContext& trim, const std::vector<AVPacket*>& gop)
+{
+    const int64_t keyframe = getPacketPTS (gop.front());
+    for (auto* packet : gop) {
+        const int64_t pts = getPacketPTS (packet);
+        if (pts != AV_NOPTS_VALUE && (pts < trim.startTs || (trim.previousReencoded && pts < keyframe))) {
+            // leading pictures of an open GOP, that reference frames before the cut, or
+            // frames that were encoded again, in that case reencodeGOP encoded them
+            continue;
+        }
+        if (trim.needsParameterSets && (packet->flags & AV_PKT_FLAG_KEY)) {
+            // the encoded GOP before replaced the parameters of the source in the decoder
+            MemoryBlock data (trim.parameterSets);
+            data.append (packet->data, static_cast<size_t> (packet->size));
+            if (! setPacketData (packet, data))
+                return false;
+            trim.needsParameterSets = false;
+        }
+        if (! writePacket (packet, AVMEDIA_TYPE_VIDEO, -trim.startTs))
+            return false;
+    }
+    return true;
+}
+
+bool FFmpegVideoWriter::reencodeGOP (TrimContext& trim, const std::vector<AVPacket*>& gop,
+                                     const std::vector<AVPacket*>& references, const int64_t encodeEnd)
+{
+    AVCodecContext* encoder = openMatchingEncoder (trim.videoStream);
+    if (encoder == nullptr)
+        return false;
+
+    bool success = true;
+    AVPacket encoded;
+    encoded.data = NULL;
+    encoded.size = 0;
+    av_init_packet (&encoded);
+
+    auto receivePackets = [&]
+    {
+        while (success && avcodec_receive_packet (encoder, &encoded) >= 0) {
+            success = writeEncodedPacket (trim, &encoded);
+            av_packet_unref (&encoded);
+        }
+    };
+
+    // the frames of the references are shown before the first picture of the GOP
+    int64_t firstPTS = trim.startTs;
+    if (! references.empty()) {
+        firstPTS = std::numeric_limits<int64_t>::max();
+        for (auto* packet : gop)
+            if (getPacketPTS (packet) != AV_NOPTS_VALUE)
+                firstPTS = jmin (firstPTS, getPacketPTS (packet));
+        firstPTS = jmax (firstPTS, trim.startTs);
+    }
+
+    auto receiveFrames = [&]
+    {
+        while (success && avcodec_receive_frame (trim.videoDecoder, trim.frame) >= 0) {
+            const int64_t pts = av_frame_get_best_effort_timestamp (trim.frame);
+            if (pts != AV_NOPTS_VALUE && pts >= firstPTS && pts < jmin (encodeEnd, trim.endTs)) {
+                trim.frame->pts = pts;
+                trim.frame->pict_type = AV_PICTURE_TYPE_NONE;
+                if (avcodec_send_frame (encoder, trim.frame) >= 0)
+                    receivePackets();
+            }
+            av_frame_unref (trim.frame);
+        }
+    };
+
+    for (auto* packet : references) {
+        if (avcodec_send_packet (trim.videoDecoder, packet) >= 0)
+            receiveFrames();
+    }
+    for (auto* packet : gop) {
+        if (avcodec_send_packet (trim.videoDecoder, packet) >= 0)
+            receiveFrames();
+    }
+
+    // drain the decoder and the encoder, the next GOP starts fresh
+    avcodec_send_packet (trim.videoDecoder, nullptr);
+    receiveFrames();
+    avcodec_flush_buffers (trim.videoDecoder);
+
+    avcodec_send_frame (encoder, nullptr);
+    receivePackets();
+    avcodec_free_context (&encoder);
+
+    trim.needsParameterSets = trim.nalLengthSize > 0;
+    return success;
+}
+
+bool FFmpegVideoWriter::writeEncodedPacket (TrimContext& trim, AVPacket* packet)
+{
+    if (trim.nalLengthSize > 0 && ! setPacketData (packet, convertAnnexB (packet->data, packet->size, trim.nalLengthSize)))
+        return false;
+
+    // without B-frames dts equals pts, shift it like the copied packets are shifted
+    if (packet->pts != AV_NOPTS_VALUE)
+        packet->dts = packet->pts - trim.decodeDelay;
+
+    return writePacket (packet, AVMEDIA_TYPE_VIDEO, -trim.startTs);
+}
+
+AVCodecContext* FFmpegVideoWriter::openMatchingEncoder (const AVStream* stream) const
+{
+    const AVCodecParameters* parameters = stream->codecpar;
+    AVCodec* encoder = avcodec_find_encoder (parameters->codec_id);
+    if (encoder == nullptr) {
+        DBG ("No encoder to re-encode " + String (avcodec_get_name (parameters->codec_id)));
+        return nullptr;
+    }
+
+    AVCodecContext* context = avcodec_alloc_context3 (encoder);
+    context->width          = parameters->width;
+    context->height         = parameters->height;
+    context->pix_fmt        = static_cast<AVPixelFormat> (parameters->format);
+    context->sample_aspect_ratio = parameters->sample_aspect_ratio;
+    context->color_range    = parameters->color_range;
+    context->color_primaries = parameters->color_primaries;
+    context->color_trc      = parameters->color_trc;
+    context->colorspace     = parameters->color_space;
+    context->profile        = parameters->profile;
+    context->level          = parameters->level;
+    context->time_base      = stream->time_base;
+    context->framerate      = stream->avg_frame_rate;
+    context->bit_rate       = parameters->bit_rate;
+    // one keyframe at the start and no reordering, so the packets fit between the copied ones
+    context->gop_size       = std::numeric_limits<int>::max();
+    context->max_b_frames   = 0;
+    context->thread_count   = threadBudget > 1 ? threadBudget - threadBudget / 2 : threadBudget;
+    context->thread_type    = threadType;
+
+    AVDictionary* options = nullptr;
+    if (parameters->codec_id == AV_CODEC_ID_H264 || parameters->codec_id == AV_CODEC_ID_HEVC) {
+        // the few frames should not stand out against the copied ones
+        if (parameters->bit_rate <= 0)
+            av_dict_set (&options, "crf", "16", 0);
+        av_dict_set (&options, "preset", "medium", 0);
+    }
+
+    const int ret = avcodec_open2 (context, encoder, &options);
+    av_dict_free (&options);
+    if (ret < 0) {
+        DBG ("Cannot open encoder for the cut points");
+        avcodec_free_context (&context);
+        return nullptr;
+    }
+    return context;
+}
+
+void FFmpegVideoWriter::writeTrimmedAudio (TrimContext& trim, const AVPacket* packet)
+{
+    if (avcodec_send_packet (trim.audioDecoder, packet) < 0)
+        return;
+
+    while (trim.audioSamplesWritten < trim.numAudioSamples &&
+           avcodec_receive_frame (trim.audioDecoder, trim.frame) >= 0) {
+        const int64_t pts = av_frame_get_best_effort_timestamp (trim.frame);
+        const double  frameSeconds = pts != AV_NOPTS_VALUE ? av_q2d (trim.audioStream->time_base) * pts : trim.startSeconds;
+
+        const int maxSamples = swr_get_out_samples (trim.resampler, trim.frame->nb_samples);
+        trim.audioBuffer.setSize (2, jmax (1, maxSamples), false, false, true);
+        const int numConverted = swr_convert (trim.resampler,
+                                              reinterpret_cast<uint8_t**> (trim.audioBuffer.getArrayOfWritePointers()), maxSamples,
+                                              const_cast<const uint8_t**> (trim.frame->extended_data), trim.frame->nb_samples);
+        av_frame_unref (trim.frame);
+        if (numConverted <= 0)
+            continue;
+
+        // everything goes to the writer in pieces of one encoder frame
+        const int frameSize = getAudioFrameSize();
+
+        int start = 0;
+        if (trim.audioSamplesWritten == 0) {
+            // the first block is aligned to the cut, later blocks simply follow
+            const int position = roundToInt ((frameSeconds - trim.startSeconds) * sampleRate);
+            if (position > 0) {
+                // the audio starts after the cut, fill the gap with silence
+                const int numSilent = static_cast<int> (jmin (static_cast<juce::int64> (position), trim.numAudioSamples));
+                AudioBuffer<float> silence (2, frameSize);
+                silence.clear();
+                for (int offset = 0; offset < numSilent; offset += frameSize) {
+                    AudioSourceChannelInfo info (&silence, 0, jmin (frameSize, numSilent - offset));
+                    writeNextAudioBlock (info);
+                }
+                trim.audioSamplesWritten = numSilent;
+            }
+            start = jmax (0, -position);
+        }
+
+        const int numSamples = static_cast<int> (jmin (static_cast<juce::int64> (numConverted - start),
+                                                       trim.numAudioSamples - trim.audioSamplesWritten));
+        if (numSamples <= 0)
+            continue;
+
+        for (int offset = 0; offset < numSamples; offset += frameSize) {
+            AudioSourceChannelInfo info (&trim.audioBuffer, start + offset, jmin (frameSize, numSamples - offset));
+            writeNextAudioBlock (info);
+        }
+        trim.audioSamplesWritten += numSamples;
+    }
+}
+
 void FFmpegVideoWriter::closeMovieFile ()
 {
     finishWriting ();
@@ -351,21 +1268,33 @@ void FFmpegVideoWriter::closeMovieFile ()
 
 void FFmpegVideoWriter::finishWriting ()
 {
+    if (encoderThread)
+        encoderThread->waitUntilEmpty();
+
     if (formatContext) {
+        // write what is left, the last frame is padded with silence
+        while (audioContext && audioFifo.getNumReady() > 0)
+            if (! writeAudioFrame (true))
+                break;
+
         AVMediaType mediaType;
         for (int idx=0; idx < formatContext->nb_streams; ++idx) {
-            if (idx == videoStreamIdx) {
+            if (idx == videoStreamIdx && videoContext) {
                 if (!(videoContext->codec->capabilities &
                       AV_CODEC_CAP_DELAY))
-                    break;
+                    continue;
                 mediaType = AVMEDIA_TYPE_VIDEO;
             }
-            else if (idx == audioStreamIdx) {
+            else if (idx == audioStreamIdx && audioContext) {
                 if (!(audioContext->codec->capabilities &
                       AV_CODEC_CAP_DELAY))
-                    break;
+                    continue;
                 mediaType = AVMEDIA_TYPE_AUDIO;
             }
+            else if (idx == videoStreamIdx || idx == audioStreamIdx) {
+                // copied streams have no encoder to flush
+                continue;
+            }
             else {
                 break;
             }
@@ -381,13 +1310,20 @@ void FFmpegVideoWriter::finishWriting ()
 
 void FFmpegVideoWriter::closeContexts ()
 {
-    avformat_free_context (formatContext);
+    if (formatContext) {
+        if (formatContext->flags & AVFMT_FLAG_CUSTOM_IO) {
+            // the pb belongs to outputIO, which flushes it into the stream
+            formatContext->pb = nullptr;
+        }
+        else if (formatContext->oformat && !(formatContext->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep (&formatContext->pb);
+        }
+        avformat_free_context (formatContext);
+    }
+    outputIO = nullptr;
     videoStreamIdx  = -1;
     audioStreamIdx  = -1;
     subtitleStreamIdx = -1;
-    videoContext = nullptr;
-    audioContext = nullptr;
-    subtitleContext = nullptr;
     avcodec_free_context (&videoContext);
     avcodec_free_context (&audioContext);
     avcodec_free_context (&subtitleContext);
@@ -399,11 +1335,70 @@ void FFmpegVideoWriter::closeContexts ()
 
 void FFmpegVideoWriter::writeNextAudioBlock (juce::AudioSourceChannelInfo& info)
 {
-    audioFifo.addToFifo (*info.buffer, info.numSamples);
-    writeAudioFrame (false);
+    if (audioContext == nullptr)
+        return;
+
+    // the block can be longer than the FIFO, so add it in pieces that fit
+    // and encode all complete frames in between
+    const int frameSize = getAudioFrameSize();
+    int offset = 0;
+    while (offset < info.numSamples) {
+        const int numSamples = jmin (info.numSamples - offset, audioFifo.getFreeSpace());
+        if (numSamples <= 0) {
+            // an encoder frame doesn't fit into the FIFO
+            jassertfalse;
+            return;
+        }
+        const int start = info.startSample + offset;
+        audioFifo.addToFifo (*info.buffer, start + numSamples, start);
+        offset += numSamples;
+
+        while (audioFifo.getNumReady() >= frameSize)
+            if (! writeAudioFrame (false))
+                return;
+    }
 }
 
 void FFmpegVideoWriter::writeNextVideoFrame (const juce::Image& image, const juce::int64 timestamp)
+{
+    if (encoderThread)
+        encoderThread->pushFrame (image, timestamp);
+    else
+        encodeImage (image, timestamp);
+}
+
+void FFmpegVideoWriter::setAsyncEncoding (const bool shouldBeAsync, const int queueSize, const AsyncPolicy policy)
+{
+    if (encoderThread) {
+        // frames submitted so far are encoded with the previous settings
+        encoderThread->waitUntilEmpty();
+        encoderThread = nullptr;
+    }
+    if (shouldBeAsync)
+        encoderThread = new EncoderThread (*this, queueSize, policy);
+}
+
+bool FFmpegVideoWriter::isAsyncEncoding () const
+{
+    return encoderThread != nullptr;
+}
+
+int FFmpegVideoWriter::getNumQueuedFrames () const
+{
+    return encoderThread ? encoderThread->getNumQueuedFrames() : 0;
+}
+
+int FFmpegVideoWriter::getNumDroppedFrames () const
+{
+    return numDroppedFrames;
+}
+
+juce::int64 FFmpegVideoWriter::getNumWrittenPackets () const
+{
+    return numWrittenPackets;
+}
+
+void FFmpegVideoWriter::encodeImage (const juce::Image& image, const juce::int64 timestamp)
 {
     // use scaler and add interface for image processing / e.g. branding
     if (videoContext) {
@@ -416,21 +1411,15 @@ void FFmpegVideoWriter::writeNextVideoFrame (const juce::Image& image, const juc
                                          videoContext->height,
                                          videoContext->pix_fmt);
         }
-        AVFrame* frame = av_frame_alloc ();
-        frame->width = videoContext->width;
-        frame->height = videoContext->height;
-        frame->format = videoContext->pix_fmt;
-        frame->pts = timestamp;
-        av_frame_set_color_range (frame, videoContext->color_range);
-        int ret = av_image_alloc(frame->data, frame->linesize,
-                                 videoContext->width,
-                                 videoContext->height,
-                                 videoContext->pix_fmt, 32);
-        if (ret < 0) {
+        AVFrame* frame = framePool->acquireFrame (videoContext->width,
+                                                  videoContext->height,
+                                                  videoContext->pix_fmt);
+        if (frame == nullptr) {
             DBG ("Could not allocate raw picture buffer");
-            av_free (&frame);
             return;
         }
+        frame->pts = timestamp;
+        av_frame_set_color_range (frame, videoContext->color_range);
         outVideoScaler->convertImageToFrame (frame, image);
         encodeWriteFrame (frame, AVMEDIA_TYPE_VIDEO);
     }
@@ -442,38 +1431,28 @@ bool FFmpegVideoWriter::writeAudioFrame (const bool flush)
         isPositiveAndBelow (audioStreamIdx, static_cast<int> (formatContext->nb_streams)))
     {
 
-        int numFrameSamples  = audioContext->frame_size;
+        const int numFrameSamples = getAudioFrameSize();
 
         if (audioFifo.getNumReady() >= numFrameSamples || flush) {
             const uint64_t channelLayout = AV_CH_LAYOUT_STEREO;
-            const int numChannels = av_get_channel_layout_nb_channels (channelLayout);
-            AVFrame* frame = av_frame_alloc ();
-            frame->nb_samples   = numFrameSamples;
-            frame->format       = AV_SAMPLE_FMT_FLTP;
-            frame->channel_layout = channelLayout;
-            frame->channels     = numChannels;
+            AVFrame* frame = framePool->acquireFrame (numFrameSamples, AV_SAMPLE_FMT_FLTP, channelLayout);
+            if (frame == nullptr) {
+                DBG ("Could not allocate audio frame buffer");
+                return false;
+            }
             frame->pts          = audioWritePosition;
             DBG ("Start writing audio frame, pts: " + String (audioWritePosition));
-            int bufferSize = av_samples_get_buffer_size (nullptr, frame->channels, frame->nb_samples, AV_SAMPLE_FMT_FLTP, 0);
-            float* samples = static_cast<float*> (av_malloc (bufferSize));
-            avcodec_fill_audio_frame (frame,
-                                      frame->channels,
-                                      static_cast<enum AVSampleFormat> (frame->format),
-                                      (const uint8_t*) (samples),
-                                      bufferSize,
-                                      0);
-
-            float** sampleData = new float*[numChannels];
+
+            const int numReady = jmin (audioFifo.getNumReady(), numFrameSamples);
+            audioFifo.readFromFifo (reinterpret_cast<float**> (frame->extended_data), numReady);
             for (int i=0; i < frame->channels; ++i) {
-                sampleData[i] = samples + i * frame->nb_samples;
+                // pad the last frame with silence when flushing
+                FloatVectorOperations::clear (reinterpret_cast<float*> (frame->extended_data [i]) + numReady,
+                                              numFrameSamples - numReady);
             }
-            audioFifo.readFromFifo (sampleData, numFrameSamples);
 
             encodeWriteFrame (frame, AVMEDIA_TYPE_AUDIO);
 
-            delete[] sampleData;
-            //av_freep (buffer);
-
             audioWritePosition += numFrameSamples;
         }
         
@@ -482,7 +1461,15 @@ bool FFmpegVideoWriter::writeAudioFrame (const bool flush)
     return false;
 }
 
+int FFmpegVideoWriter::getAudioFrameSize () const
+{
+    // encoders with variable frame size report 0, they take any size
+    return (audioContext && audioContext->frame_size > 0) ? audioContext->frame_size : 1024;
+}
+
 int FFmpegVideoWriter::encodeWriteFrame (AVFrame *frame, AVMediaType type) {
+    // the video and the audio codec can encode at the same time
+    const ScopedLock lock (type == AVMEDIA_TYPE_VIDEO ? videoEncoderLock : audioEncoderLock);
     int got_frame = 0;
     if (formatContext) {
         int ret;
@@ -498,7 +1485,7 @@ int FFmpegVideoWriter::encodeWriteFrame (AVFrame *frame, AVMediaType type) {
             av_packet_rescale_ts (&packet,
                                   videoContext->time_base,
                                   formatContext->streams [videoStreamIdx]->time_base);
-            av_frame_free (&frame);
+            framePool->releaseFrame (frame);
             if (ret < 0) {
                 char error[255];
                 av_strerror (ret, error, 255);
@@ -512,7 +1499,7 @@ int FFmpegVideoWriter::encodeWriteFrame (AVFrame *frame, AVMediaType type) {
             av_packet_rescale_ts (&packet,
                                   audioContext->time_base,
                                   formatContext->streams [audioStreamIdx]->time_base);
-            av_frame_free (&frame);
+            framePool->releaseFrame (frame);
             if (ret < 0) {
                 char error[255];
                 av_strerror (ret, error, 255);
@@ -527,15 +1514,17 @@ int FFmpegVideoWriter::encodeWriteFrame (AVFrame *frame, AVMediaType type) {
         }
 
         if (got_frame == 1) {
+            const ScopedLock muxer (muxerLock);
             if (av_interleaved_write_frame (formatContext, &packet) < 0) {
                 DBG ("Error when writing data");
                 return false;
             }
+            ++numWrittenPackets;
         }
     }
     else {
         DBG ("No writer open, did not write frame");
-        av_frame_free (&frame);
+        framePool->releaseFrame (frame);
     }
     return got_frame == 1;
 }
@@ -548,15 +1537,34 @@ void FFmpegVideoWriter::videoSizeChanged (const int width, const int height, con
 
 void FFmpegVideoWriter::displayNewFrame (const AVFrame* frame)
 {
-    if (!inVideoScaler) {
-        inVideoScaler = new FFmpegVideoScaler();
-        inVideoScaler->setupScaler (frame->width, frame->height, static_cast<AVPixelFormat> (frame->format),
-                                    videoWidth,   videoHeight,   AV_PIX_FMT_BGR0);
-    }
+    if (!videoContext)
+        return;
+
     DBG ("Write video frame, pts: " + String (frame->pts));
-    Image picture (Image::RGB, videoWidth, videoHeight, true);
-    inVideoScaler->convertFrameToImage (picture, frame);
-    writeNextVideoFrame (picture, frame->pts);
+    AVFrame* outFrame = nullptr;
+    if (frame->width  == videoContext->width &&
+        frame->height == videoContext->height &&
+        frame->format == videoContext->pix_fmt) {
+        // same format, the encoder can use the decoded picture directly
+        outFrame = framePool->acquireFrame ();
+        av_frame_ref (outFrame, frame);
+    }
+    else {
+        if (!inVideoScaler) {
+            inVideoScaler = new FFmpegVideoScaler();
+            inVideoScaler->setupScaler (frame->width, frame->height, static_cast<AVPixelFormat> (frame->format),
+                                        videoContext->width, videoContext->height, videoContext->pix_fmt);
+        }
+        outFrame = framePool->acquireFrame (videoContext->width, videoContext->height, videoContext->pix_fmt);
+        if (outFrame == nullptr) {
+            DBG ("Could not allocate raw picture buffer");
+            return;
+        }
+        inVideoScaler->convertFrameToFrame (outFrame, frame);
+    }
+    outFrame->pts = frame->pts;
+    av_frame_set_color_range (outFrame, videoContext->color_range);
+    encodeWriteFrame (outFrame, AVMEDIA_TYPE_VIDEO);
 }
 
 
@@ -41,6 +41,11 @@
 #ifndef FILMSTRO_FFMPEG_FFMPEGVIDEOWRITER_H_INCLUDED
 #define FILMSTRO_FFMPEG_FFMPEGVIDEOWRITER_H_INCLUDED
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
 class FFmpegVideoSource;
 
 
@@ -48,6 +53,17 @@ class FFmpegVideoWriter : public FFmpegVideoListener
 {
 public:
 
+    /** What writeNextVideoFrame does in async mode, when the queue is full */
+    enum AsyncPolicy
+    {
+        /** wait until the encoder took a frame, so no frame is lost */
+        blockWhenFull = 0,
+        /** discard the submitted frame */
+        dropNewestWhenFull,
+        /** discard the oldest waiting frame to make room */
+        dropOldestWhenFull
+    };
+
     FFmpegVideoWriter (const juce::String& format = juce::String());
     ~FFmpegVideoWriter();
 
@@ -55,12 +71,18 @@ public:
     void setVideoCodec (AVCodecID codec = AV_CODEC_ID_PROBE);
     /** Set the requested audio codec before opening a file */
     void setAudioCodec (AVCodecID codec = AV_CODEC_ID_PROBE);
+    /** Returns the requested audio codec, AV_CODEC_ID_NONE if no audio is written */
+    AVCodecID getAudioCodec () const;
+
     /** Set the requested subtitle codec before opening a file */
     void setSubtitleCodec (AVCodecID codec = AV_CODEC_ID_PROBE);
 
     /** Set the audio sample rate before opening a file */
     void setSampleRate (const int newSampleRate);
 
+    /** Returns the audio sample rate, the audio blocks have to be in */
+    int getSampleRate () const;
+
     /** Set the video size before opening a file */
     void setVideoSize (const int width, const int height);
 
@@ -70,30 +92,111 @@ public:
     /** Set the pixel aspect ratio as fraction before opening a file */
     void setPixelAspect (const int num, const int den);
 
+    /** Set the number of threads the encoders may start before opening a file. The
+     budget goes to the video encoder, the audio encoder never starts threads of its
+     own. The default of 1 encodes without additional threads, a numThreads of 0 lets
+     ffmpeg choose according to the number of cores. The threadType can be
+     FF_THREAD_FRAME, FF_THREAD_SLICE or both. */
+    void setThreadingOptions (const int numThreads, const int threadType = FF_THREAD_FRAME | FF_THREAD_SLICE);
+
     /** Set the timebase for the stream, provide either 
      AVMEDIA_TYPE_VIDEO, AVMEDIA_TYPE_AUDIO, AVMEDIA_TYPE_SUBTITLE */
     void setTimeBase (AVMediaType type, AVRational timebase);
 
+    /** Returns the timebase, in which the timestamps of frames for that media type are expected */
+    AVRational getTimeBase (AVMediaType type) const;
+
     /** copies settings from a context (e.g. FFmpegVideoReader) to the writer */
     void copySettingsFromContext (const AVCodecContext* context);
 
+    /** copies codecs, sizes, formats, timebases and threading options of another
+     writer, e.g. to encode parts of the same export in parallel. Stream copies
+     are not copied. */
+    void copySettingsFrom (const FFmpegVideoWriter& other);
+
+    /** Copies the packets of sourceStream into the output without decoding and
+     encoding them again. Call this before opening a file, it replaces the encoder
+     for the media type of the stream. Only audio and video streams can be copied.
+     The parameters are copied, so the source may be closed afterwards. */
+    void setStreamCopy (const AVStream* sourceStream);
+
+    /** Removes all stream copies, so the next file encodes all streams again */
+    void clearStreamCopies ();
+
+    /** Returns true, if the packets of that media type are copied instead of encoded */
+    bool isStreamCopy (AVMediaType type) const;
+
+    /** Writes a packet of a copied stream. The timestamps are moved by offset, given in
+     the time base of the source stream, and rescaled to the output stream. The packet
+     itself is not changed. */
+    bool writePacket (const AVPacket* packet, AVMediaType type, const juce::int64 offset = 0);
+
     /** Opens a file for writing audio, video and subtitles. The settings like
      encoders, samplerate etc. has to be set first. */
     bool openMovieFile (const juce::File& outputFile, const juce::String& format=juce::String());
 
+    /** Opens a juce::OutputStream for writing, e.g. a MemoryOutputStream or a pipe.
+     The format has to be given, since there is no file name to guess it from.
+     If takeOwnership is true, the writer deletes the stream when it is closed. */
+    bool openMovieStream (juce::OutputStream* outputStream, const juce::String& format, const bool takeOwnership=false);
+
+    /** Set the size in bytes of the buffer, that collects the muxed data before it is
+     handed to the OutputStream. Only used for streams opened with openMovieStream. */
+    void setOutputBufferSize (const int numBytes);
+
+    /** Writes the part from startSeconds to endSeconds of inputFile into outputFile.
+     Every whole GOP inside the range is copied, only the GOPs at the cut points are
+     decoded and encoded again with the codec of the source. The audio is decoded, cut
+     at the exact sample and encoded with the audio settings of this writer, so set an
+     audio codec to keep it. The times are relative to the start of the file, also for
+     files like MPEG-TS, whose timestamps don't start at zero. The writer must not have
+     a file open, stream copies set with setStreamCopy are kept for the next file. This
+     blocks until the file is written.
+
+     For H.264 and HEVC the parameter sets are repeated in the stream, where copied and
+     encoded GOPs meet. In mp4 and mov the sample entry is marked as avc3 or hev1 then,
+     which allows parameter sets in the samples. Where the muxer doesn't know these tags,
+     it stays avc1 or hvc1, which FFmpeg, VLC and the browsers decode as well, but strict
+     players, that only read the parameters from the container header, might show
+     artefacts at the cut points. */
+    bool trimMovieFile (const juce::File& inputFile, const juce::File& outputFile,
+                        const double startSeconds, const double endSeconds,
+                        const juce::String& format = juce::String());
+
     /** Closes the movie file. Also flushes all left over samples and frames */
     void closeMovieFile ();
 
-    /** Append a chunk of audio data. It will call writeAudioFrame to get rid of the data */
+    /** Append a chunk of audio data of any length. It will call writeAudioFrame for each complete frame */
     void writeNextAudioBlock (juce::AudioSourceChannelInfo& info);
 
-    /** Write the next video frame from juce image */
+    /** Write the next video frame from juce image. In async mode the image is
+     copied into the queue and scaled and encoded on the encoder thread. */
     void writeNextVideoFrame (const juce::Image& image, const juce::int64 timestamp);
 
+    /** Scales and encodes the images of writeNextVideoFrame on a background thread,
+     so the caller, e.g. the message thread, only pays for copying the image. Up to
+     queueSize frames can wait for the encoder, the policy decides what happens if
+     the encoder can't keep up. closeMovieFile waits for the queued frames. */
+    void setAsyncEncoding (const bool shouldBeAsync, const int queueSize = 8,
+                           const AsyncPolicy policy = blockWhenFull);
+
+    /** Returns true, if writeNextVideoFrame hands the frames to the encoder thread */
+    bool isAsyncEncoding () const;
+
+    /** Returns the number of frames waiting for the encoder thread */
+    int getNumQueuedFrames () const;
+
+    /** Returns the number of frames dropped because the queue was full */
+    int getNumDroppedFrames () const;
+
+    /** Returns the number of packets muxed into the current or the last file */
+    juce::int64 getNumWrittenPackets () const;
+
     void videoSizeChanged (const int width, const int height, const AVPixelFormat) override;
 
     /** This callback receives frames from e.g. the FFmpegVideoReader to be written to the video file.
-     The timestamp has to be set in the frame. */
+     The timestamp has to be set in the frame. If size and pixel format match the encoder,
+     the frame is encoded without copying the picture. */
     void displayNewFrame (const AVFrame*) override;
 
     /** Returns the names of available output formats */
@@ -102,6 +205,8 @@ public:
     // ==============================================================================
 private:
 
+    bool openMovie (const juce::String& filename, const juce::String& format);
+
     void closeContexts ();
 
     void finishWriting ();
@@ -109,8 +214,53 @@ private:
     /** Write audio data to frame, if there is enough. If flush is set to true, it will append silence to fill the last frame. */
     bool writeAudioFrame (const bool flush=false);
 
+    /** Returns the number of samples the audio encoder takes per frame */
+    int getAudioFrameSize () const;
+
     int encodeWriteFrame (AVFrame *frame, AVMediaType type);
 
+    /** scales the image into a frame and encodes it, called from writeNextVideoFrame or the encoder thread */
+    void encodeImage (const juce::Image& image, const juce::int64 timestamp);
+
+    /** encodes the images of writeNextVideoFrame in async mode */
+    class EncoderThread;
+
+    /** A stream, whose packets are copied from a source */
+    struct StreamCopy
+    {
+        AVCodecParameters*  parameters;
+        AVRational          sourceTimeBase;
+        /** the packets repeat the parameter sets, mp4 signals that with avc3 or hev1 */
+        bool                inBandParameterSets;
+    };
+
+    StreamCopy& getStreamCopy (AVMediaType type);
+
+    /** adds the output stream for a copy, returns the index of the stream or -1 */
+    int addCopiedStream (const StreamCopy& copy);
+
+    /** the state of trimMovieFile */
+    struct TrimContext;
+
+    /** opens an encoder with the parameters of the source stream for the GOPs at the cut points */
+    AVCodecContext* openMatchingEncoder (const AVStream* stream) const;
+
+    /** copies the packets of a GOP, that lies completely inside the range. The leading
+     pictures are skipped, if they were encoded again */
+    bool copyGOP (TrimContext& trim, const std::vector<AVPacket*>& gop);
+
+    /** decodes a GOP at a cut point and encodes the frames inside the range before
+     encodeEnd. The references are decoded first without encoding their frames, so the
+     leading pictures of an open GOP find the frames they refer to */
+    bool reencodeGOP (TrimContext& trim, const std::vector<AVPacket*>& gop,
+                      const std::vector<AVPacket*>& references, const int64_t encodeEnd);
+
+    /** writes an encoded packet of reencodeGOP into the copied stream */
+    bool writeEncodedPacket (TrimContext& trim, AVPacket* packet);
+
+    /** decodes an audio packet and writes the samples inside the range */
+    void writeTrimmedAudio (TrimContext& trim, const AVPacket* packet);
+
     // ==============================================================================
 
     /** This is the samplecode of the next sample to be written */
@@ -118,6 +268,10 @@ private:
 
     AVFormatContext*        formatContext;
 
+    /** set when writing to a juce::OutputStream instead of a file */
+    juce::ScopedPointer<FFmpegOutputStreamIO> outputIO;
+    int                     outputBufferSize;
+
     AVCodecContext*         videoContext;
     AVCodecContext*         audioContext;
     AVCodecContext*         subtitleContext;
@@ -142,12 +296,30 @@ private:
     AVPixelFormat           pixelFormat;
     AVRational              pixelAspect;
 
+    int                     threadBudget;
+    int                     threadType;
+
+    StreamCopy              videoCopy;
+    StreamCopy              audioCopy;
+
     // buffer audio to match the video's audio frame size
     AudioBufferFIFO<float>  audioFifo;
 
     juce::ScopedPointer<FFmpegVideoScaler> outVideoScaler;
     juce::ScopedPointer<FFmpegVideoScaler> inVideoScaler;
 
+    juce::SharedResourcePointer<FFmpegFramePool> framePool;
+
+    /** the encoder thread and writeNextAudioBlock encode in parallel, each codec is
+     used by one thread at a time, only the muxer is shared */
+    juce::CriticalSection   videoEncoderLock;
+    juce::CriticalSection   audioEncoderLock;
+    juce::CriticalSection   muxerLock;
+
+    juce::ScopedPointer<EncoderThread> encoderThread;
+    std::atomic<int>        numDroppedFrames;
+    std::atomic<juce::int64> numWrittenPackets;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FFmpegVideoWriter)
 };
 